@@ -17,6 +17,16 @@ var alphaReplace = function( bottom, top ){
 	return bottom;
 };
 
+var addOffset = function( bottom, top ){
+	var add = function( b, t ){ return (b + t - 127) & 255; };
+	return {
+			r: add( bottom.r, top.r )
+		,	g: add( bottom.g, top.g )
+		,	b: add( bottom.b, top.b )
+		,	a: add( bottom.a, top.a )
+		};
+};
+
 var getRgba = function( data, offset ){
 	return {
 			r: data[offset+0]
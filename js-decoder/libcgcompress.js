@@ -32,6 +32,7 @@ var parseCompositeOp = function( layer ){
 	switch( comp ){
 		case "cgcompress:alpha-replace": return alphaReplace;
 		case "svg:src-over": return svgOverlay;
+		case "cgcompress:add-offset": return addOffset;
 		default: throw "unsupported compositing operation: " + comp;
 	};
 };
@@ -0,0 +1,76 @@
+/*
+	This file is part of cgCompress.
+	
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Blending.hpp"
+
+#include <algorithm>
+
+using Word = PixelMask::Word;
+
+/** \return Slot mask of the pixels shown in word **index** */
+static Word shown_slots( const Word* mask, unsigned shown, int index )
+	{ return mask ? PixelMask::matches( mask[index], shown ) : PixelMask::LOW; }
+
+/** \return true if the pixel at **offset** in **slots** is set */
+static bool slot( Word slots, int offset )
+	{ return (slots >> (offset * PixelMask::BITS)) & 1; }
+
+void Blending::blend_row( Mode mode, QRgb* out, const QRgb* in, const Word* mask, unsigned shown, int width ){
+	for( int start=0, i=0; start<width; start+=PixelMask::PER_WORD, i++ ){
+		auto slots = shown_slots( mask, shown, i );
+		int amount = std::min( PixelMask::PER_WORD, width - start );
+		auto out_word = out + start;
+		auto in_word  = in  + start;
+		
+		//Nothing to paint in this word
+		if( (slots & PixelMask::range( 0, amount )) == 0 )
+			continue;
+			
+		switch( mode ){
+			case Mode::ALPHA_REPLACE:
+				for( int ix=0; ix<amount; ix++ ){
+					auto pixel = in_word[ix];
+					bool replace = slot( slots, ix ) & (pixel != TRANS_SET);
+					out_word[ix] = replace ? pixel : out_word[ix];
+				}
+				break;
+				
+			case Mode::SOURCE_OVER:
+				for( int ix=0; ix<amount; ix++ ){
+					auto blended = source_over( out_word[ix], in_word[ix] );
+					out_word[ix] = slot( slots, ix ) ? blended : out_word[ix];
+				}
+				break;
+			
+			case Mode::ADD_OFFSET:
+				for( int ix=0; ix<amount; ix++ ){
+					auto changed = add_offset( out_word[ix], in_word[ix] );
+					out_word[ix] = slot( slots, ix ) ? changed : out_word[ix];
+				}
+				break;
+		}
+	}
+}
+
+const char* Blending::composite_op( Mode mode ){
+	switch( mode ){
+		case Mode::ALPHA_REPLACE: return "cgcompress:alpha-replace";
+		case Mode::SOURCE_OVER:   return "svg:src-over";
+		case Mode::ADD_OFFSET:    return "cgcompress:add-offset";
+	}
+	return "";
+}
@@ -0,0 +1,104 @@
+/*
+	This file is part of cgCompress.
+	
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BLENDING_HPP
+#define BLENDING_HPP
+
+#include <QImage>
+
+#include "PackedMask.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+/**
+	Compositing of layers the same way the decoder does it, working directly on
+	rows of ARGB32 pixels. The loops are written without branches on the pixel
+	data, so the compiler can vectorize them.
+*/
+
+namespace Blending{
+
+/** Pixel value for pixels not shown in saved images */
+const QRgb TRANS_SET = qRgba( 255, 0, 255, 0 );
+
+/** Value added to each channel difference in add-offset layers */
+const int OFFSET = 127;
+/** Pixel value which does not change anything in add-offset layers */
+const QRgb OFFSET_NEUTRAL = qRgba( OFFSET, OFFSET, OFFSET, OFFSET );
+
+/** How a layer is painted on top of the layers below */
+enum class Mode{
+	ALPHA_REPLACE, ///< cgcompress:alpha-replace, shown pixels replace the pixels below
+	SOURCE_OVER,   ///< svg:src-over
+	ADD_OFFSET     ///< cgcompress:add-offset, each channel is changed by the pixel value minus OFFSET
+};
+
+/** \return The composite-op attribute value used in stack.xml for **mode** */
+const char* composite_op( Mode mode );
+
+/** \return Each byte of **a** and **b** added, modulo 256 */
+inline QRgb add_bytes( QRgb a, QRgb b ){
+	return ((a & 0x7F7F7F7Fu) + (b & 0x7F7F7F7Fu)) ^ ((a ^ b) & 0x80808080u);
+}
+
+/** \return Each byte of **b** subtracted from **a**, modulo 256 */
+inline QRgb subtract_bytes( QRgb a, QRgb b ){
+	return ((a | 0x80808080u) - (b & 0x7F7F7F7Fu)) ^ ((a ^ ~b) & 0x80808080u);
+}
+
+/** \return **bottom** changed by the add-offset pixel **offset** */
+inline QRgb add_offset( QRgb bottom, QRgb offset )
+	{ return subtract_bytes( add_bytes( bottom, offset ), OFFSET_NEUTRAL ); }
+
+/** \return The add-offset pixel which changes **bottom** to **top** */
+inline QRgb get_offset( QRgb top, QRgb bottom )
+	{ return add_bytes( subtract_bytes( top, bottom ), OFFSET_NEUTRAL ); }
+
+/** \return The largest difference of any channel between **a** and **b** */
+inline int max_channel_difference( QRgb a, QRgb b ){
+	return std::max( std::max( std::abs( qRed(   a ) - qRed(   b ) ), std::abs( qGreen( a ) - qGreen( b ) ) )
+	               , std::max( std::abs( qBlue(  a ) - qBlue(  b ) ), std::abs( qAlpha( a ) - qAlpha( b ) ) ) );
+}
+
+/** Paint a row on top of another row
+ *  \param [in] mode How to combine the pixels
+ *  \param [in,out] out The row to paint on
+ *  \param [in] in The row to paint
+ *  \param [in] mask Row of the mask for **in**, nullptr if all pixels are shown
+ *  \param [in] shown Mask value of the pixels which are shown
+ *  \param [in] width Amount of pixels in the rows */
+void blend_row( Mode mode, QRgb* out, const QRgb* in, const PixelMask::Word* mask, unsigned shown, int width );
+
+/** \return **src** painted on **dst** using svg:src-over, non-premultiplied */
+inline QRgb source_over( QRgb dst, QRgb src ){
+	unsigned src_weight = qAlpha( src ) * 255;
+	unsigned dst_weight = qAlpha( dst ) * (255 - qAlpha( src ));
+	unsigned alpha = src_weight + dst_weight;
+	unsigned divisor = alpha ? alpha : 1;
+	auto mix = [&]( unsigned s, unsigned d )
+		{ return (s * src_weight + d * dst_weight + divisor/2) / divisor; };
+	return qRgba( mix( qRed(   src ), qRed(   dst ) )
+	            , mix( qGreen( src ), qGreen( dst ) )
+	            , mix( qBlue(  src ), qBlue(  dst ) )
+	            , (alpha + 127) / 255
+	            );
+}
+
+}
+
+#endif
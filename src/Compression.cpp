@@ -21,6 +21,7 @@
 #include <lz4hc.h>
 #include <lzma.h>
 
+#include <algorithm>
 #include <vector>
 
 namespace FileSize{
@@ -36,6 +37,31 @@ int lz4compress_size( const unsigned char* data, unsigned size ){
 		);
 }
 
+/** Fast compression, for data which is decompressed again later
+ *  \param [in] data The data to compress
+ *  \param [in] size The amount of bytes in **data**
+ *  \return The compressed data, empty on failure */
+std::vector<unsigned char> lz4compress( const unsigned char* data, unsigned size ){
+	std::vector<unsigned char> buffer( LZ4_compressBound( size ) );
+	auto written = LZ4_compress_default(
+			(const char*)data, (char*)buffer.data()
+		,	size, buffer.size()
+		);
+	buffer.resize( std::max( written, 0 ) );
+	return buffer;
+}
+
+/** Decompress data from lz4compress()
+ *  \param [in] data The compressed data
+ *  \param [in] size The amount of bytes in **data**
+ *  \param [out] out Receives the decompressed data
+ *  \param [in] out_size The exact size of the decompressed data
+ *  \return true if **out** was filled */
+bool lz4decompress( const unsigned char* data, unsigned size, unsigned char* out, unsigned out_size ){
+	auto read = LZ4_decompress_safe( (const char*)data, (char*)out, size, out_size );
+	return read == int(out_size);
+}
+
 
 int lzma_compress_size( const unsigned char* data, unsigned size ){
 	//Initialize LZMA
@@ -18,12 +18,17 @@
 #ifndef COMPRESSION_HPP
 #define COMPRESSION_HPP
 
+#include <vector>
+
 
 namespace FileSize{
 
 int lz4compress_size( const unsigned char*, unsigned size );
 int lzma_compress_size( const unsigned char*, unsigned size );
 
+std::vector<unsigned char> lz4compress( const unsigned char* data, unsigned size );
+bool lz4decompress( const unsigned char* data, unsigned size, unsigned char* out, unsigned out_size );
+
 }
 
 #endif
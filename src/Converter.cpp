@@ -20,14 +20,33 @@
 #include <algorithm>
 #include <stdexcept>
 
+OffsetImage Converter::get_offset_split() const{
+	return (*base_images)[from].offset_difference( (*base_images)[to], MAX_OFFSET_DIFF );
+}
+
 Image Converter::get_primitive() const{
 	//No diff if no conversion can be made
 	if( from == to )
 		return (*base_images)[from];
+	if( offset )
+		return get_offset_split().overlay;
 	
 	return (*base_images)[from].difference( (*base_images)[to] );
 }
 
+Image Converter::get_cropped_primitive() const{
+	if( from == to )
+		return (*base_images)[from].auto_crop();
+	if( offset )
+		return get_offset_split().overlay.auto_crop();
+	
+	return (*base_images)[from].difference_cropped( (*base_images)[to] );
+}
+
+Image Converter::get_offset_primitive() const{
+	return offset ? get_offset_split().offset : Image( {0,0}, QImage() );
+}
+
 QList<int> Converter::path( const QList<Converter>& converters, int from, int to ){
 	auto conv_path = QList<int>() << from;
 	
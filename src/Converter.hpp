@@ -19,6 +19,7 @@
 #define CONVERTER_HPP
 
 #include "Image.hpp"
+#include "ImageStore.hpp"
 
 #include <utility>
 
@@ -30,22 +31,42 @@
  */
 class Converter {
 	private:
-		const QList<Image>* base_images{ nullptr };
+		const ImageStore* base_images{ nullptr };
 		int from;
 		int to;
 		int size;
+		bool offset{ false };
+		
+		/** \return The add-offset layer and overlay for this conversion */
+		OffsetImage get_offset_split() const;
 		
 	public:
+		/// Largest channel change stored in add-offset layers
+		static const int MAX_OFFSET_DIFF = 32;
+		
 		Converter(){} //NOTE: only for QtConcurrent
 		/** \param [in] base_images The images to convert on
 		 *  \param [in] from Index to the image to start on
 		 *  \param [in] to Index to the image to end on
 		 *  \param [in] format The format used for compressing
 		 */
-		Converter( const QList<Image>& base_images, int from, int to, Format format )
+		Converter( const ImageStore& base_images, int from, int to, Format format )
 			:	base_images(&base_images)
 			,	from(from), to(to) {
-				size = get_primitive().auto_crop().compressed_size( format, Format::MEDIUM ); //TODO: fix format
+				size = get_cropped_primitive().compressed_size( format, Format::MEDIUM ); //TODO: fix format
+				
+				//Store small colour changes as offsets if it is cheaper
+				if( format.get_add_offset() && from != to ){
+					auto split = get_offset_split();
+					if( split.offset.is_valid() ){
+						auto offset_size = split.offset.compressed_size( format, Format::MEDIUM )
+							+	split.overlay.auto_crop().compressed_size( format, Format::MEDIUM );
+						if( offset_size < size ){
+							offset = true;
+							size = offset_size;
+						}
+					}
+				}
 			}
 		
 		/** \return Index to the start image */
@@ -60,6 +81,15 @@ class Converter {
 		/** \return The image used for converting **/
 		Image get_primitive() const;
 		
+		/** \return The image used for converting, cropped to the changed area **/
+		Image get_cropped_primitive() const;
+		
+		/** \return true if the conversion needs an add-offset layer below the primitive */
+		bool uses_offset() const{ return offset; }
+		
+		/** \return The add-offset layer painted before the primitive, if uses_offset() **/
+		Image get_offset_primitive() const;
+		
 		static QList<int> path( const QList<Converter>& converters, int from, int to=0 );
 		
 		static auto less_size( const Converter& a, const Converter& b ){ return a.size < b.size; }
@@ -56,25 +56,20 @@ int FileSize::image_gradient_sum( QImage img ){
 	return diffs;
 }
 
-int FileSize::image_gradient_sum( const SubQImage& img, QImage mask, int pixel_different ){
+int FileSize::image_gradient_sum( const SubQImage& img, const PixelMask& mask, int pixel_different ){
 	int diffs = 0;
 	
 	auto w = img.width();
 	for( int iy=0; iy<img.height(); iy++ ){
-		auto row_alpha = mask.constScanLine( iy );
+		auto row_alpha = mask.constRow( iy );
 		auto row = img.row( iy );
+		bool left_set = PixelMask::get( row_alpha, 0 ) == unsigned(pixel_different);
 		for( int ix=1; ix<w; ix++ ){
-			auto alpha_left  = row_alpha[ix-1] != pixel_different;
-			auto alpha_right = row_alpha[ix  ] != pixel_different;
-			diffs += (alpha_left != alpha_right) ? 255 : 0;
 			//TODO: not great for images with transparency
 			//we add the difference in shown pixels
-			if( !(alpha_left || alpha_right) ){
-				QRgb left = row[ix-1], right = row[ix];
-				diffs += abs( qRed(  left) - qRed(  right) );
-				diffs += abs( qGreen(left) - qGreen(right) );
-				diffs += abs( qBlue( left) - qBlue( right) );
-			}
+			bool right_set = PixelMask::get( row_alpha, ix ) == unsigned(pixel_different);
+			diffs += gradient_pair( row[ix-1], left_set, row[ix], right_set );
+			left_set = right_set;
 		}
 	}
 	
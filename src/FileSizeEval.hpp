@@ -20,6 +20,10 @@
 
 #include <QImage>
 
+#include "PackedMask.hpp"
+
+#include <cstdlib>
+
 /**
 	Several methods to guess how much space a image will take to store compressed.
 	However they are not compariable with final filesize or another metric
@@ -31,9 +35,25 @@ namespace FileSize{
 
 int simple_alpha( QImage mask, int transparent );
 int image_gradient_sum( QImage img );
-int image_gradient_sum( const SubQImage& img, QImage mask, int pixel_different );
+int image_gradient_sum( const SubQImage& img, const PixelMask& mask, int pixel_different );
 int lz4compress_size( QImage img );
 
+/** The contribution of two neighbouring pixels to image_gradient_sum()
+ *  \param [in] left The left pixel
+ *  \param [in] left_set true if the left pixel is shown
+ *  \param [in] right The right pixel
+ *  \param [in] right_set true if the right pixel is shown
+ *  \return The cost of the pixel pair */
+inline int gradient_pair( QRgb left, bool left_set, QRgb right, bool right_set ){
+	if( left_set != right_set )
+		return 255;
+	if( !left_set )
+		return 0;
+	return std::abs( qRed(  left) - qRed(  right) )
+		+  std::abs( qGreen(left) - qGreen(right) )
+		+  std::abs( qBlue( left) - qBlue( right) );
+}
+
 }
 
 #endif
@@ -18,12 +18,25 @@
 #include "FileUtils.hpp"
 
 #include <QBuffer>
+#include <QCryptographicHash>
 #include <QFileInfo>
 #include <QImageReader>
 #include <QFile>
 
 #include <QDebug>
 
+#if defined(_WIN32)
+	#include <io.h>
+	#ifndef NOMINMAX
+		#define NOMINMAX //Keep std::min() and std::max() usable in the headers below
+	#endif
+	#include <windows.h>
+#else
+	#include <cstdio>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
 #include "Format.hpp"
 #include "Compression.hpp"
 #include "CsvWriter.hpp"
@@ -249,3 +262,77 @@ QImage withoutAlpha( QImage img ){
 	return img.convertToFormat(QImage::Format_RGB32).convertToFormat(QImage::Format_ARGB32);
 }
 
+
+/** Flush **file** and wait until the data has reached the disk, so it
+ *  survives a crash or power loss and not just the process being killed
+ *  \param [in] file An open file
+ *  \return true on success */
+bool sync_file( QFile& file ){
+	if( !file.flush() )
+		return false;
+#if defined(_WIN32)
+	return _commit( file.handle() ) == 0;
+#else
+	return fsync( file.handle() ) == 0;
+#endif
+}
+
+/** \param [in] path An existing file, which is opened without truncating
+ *  \return true if the contents of **path** have reached the disk */
+bool sync_file( QString path ){
+	QFile file( path );
+	return file.open( QIODevice::ReadWrite ) && sync_file( file );
+}
+
+/** \param [in] path A file which does not exist yet
+ *  \return The permissions QFile gives a file it creates, found by creating
+ *  **path** and removing it again. The umask is not read directly, as that
+ *  would change it for the other threads for a moment. */
+static QFileDevice::Permissions new_file_permissions( QString path ){
+	QFile probe( path );
+	if( !probe.open( QIODevice::WriteOnly ) )
+		return QFileDevice::ReadOwner | QFileDevice::WriteOwner | QFileDevice::ReadUser | QFileDevice::WriteUser;
+	auto permissions = probe.permissions();
+	probe.remove();
+	return permissions;
+}
+
+/** Move **from** to **to**, replacing **to** if it exists. Others see either
+ *  the old or the new file at **to**, never a partially written one.
+ *  **to** keeps its permissions, or gets those of a newly created file.
+ *  \param [in] from A file which already has been synced with sync_file()
+ *  \param [in] to The destination, in the same directory as **from**
+ *  \return true if **to** has been replaced */
+bool replace_file( QString from, QString to ){
+	//Temporary files are only accessible by the owner
+	auto permissions = QFile::exists( to ) ? QFile::permissions( to ) : new_file_permissions( from + ".new" );
+	if( !QFile::setPermissions( from, permissions ) )
+		return false;
+	
+#if defined(_WIN32)
+	return MoveFileExW( (const wchar_t*)from.utf16(), (const wchar_t*)to.utf16()
+		,	MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH );
+#else
+	if( std::rename( QFile::encodeName( from ).constData(), QFile::encodeName( to ).constData() ) != 0 )
+		return false;
+	
+	//Sync the directory too, otherwise the rename itself might be lost.
+	//The file has been replaced already, so this can't fail the replacement.
+	auto dir_path = QFileInfo( to ).absolutePath();
+	auto dir = open( QFile::encodeName( dir_path ).constData(), O_RDONLY );
+	if( dir < 0 || fsync( dir ) != 0 )
+		qWarning( "Could not sync the directory '%s'", dir_path.toLocal8Bit().constData() );
+	if( dir >= 0 )
+		close( dir );
+	return true;
+#endif
+}
+
+/** \return SHA-1 of the contents of the file at **path**, empty if it could not be read */
+QByteArray hash_file( QString path ){
+	QFile file( path );
+	QCryptographicHash hash( QCryptographicHash::Sha1 );
+	if( !file.open( QIODevice::ReadOnly ) || !hash.addData( &file ) )
+		return {};
+	return hash.result().toHex();
+}
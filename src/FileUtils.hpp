@@ -20,6 +20,7 @@
 
 #include <QString>
 #include <QDir>
+#include <QFile>
 #include <QImage>
 
 #include "Format.hpp"
@@ -39,5 +40,10 @@ QStringList expandFolders( QStringList files );
 QImage discardTransparent( QImage img, QRgb discard_color = qRgb(0,0,0) );
 QImage withoutAlpha( QImage img );
 
+bool sync_file( QFile& file );
+bool sync_file( QString path );
+bool replace_file( QString from, QString to );
+QByteArray hash_file( QString path );
+
 #endif
 
@@ -20,6 +20,9 @@
 
 #include <QBuffer>
 #include <QByteArray>
+#include <QVector>
+
+#include <vector>
 
 static QByteArray to_raw_data( QImage img ){
 	img = img.convertToFormat( QImage::Format_ARGB32 );
@@ -44,6 +47,84 @@ static QByteArray to_raw_data( QImage img ){
 	return data;
 }
 
+/** Small hash set assigning palette indexes to colours, used for finding
+ *  images which have few enough colours to be stored with a palette */
+class Palette{
+	public:
+		static const int MAX_COLOURS = 256;
+		
+	private:
+		static const int SLOTS = 1024; ///< Power of two, so it is never more than 25% full
+		QVector<QRgb> colours;
+		std::vector<int> slots; ///< Index into **colours**, or -1 if unused
+		
+		static int hash( QRgb colour ){ return (colour * 0x9E3779B1u) >> 22; }
+		
+	public:
+		Palette() : slots( SLOTS, -1 ) { colours.reserve( MAX_COLOURS ); }
+		
+		/** \return The palette index of **colour**, or -1 if there are too many colours */
+		int index( QRgb colour ){
+			for( int slot = hash( colour ); ; slot = (slot + 1) & (SLOTS - 1) ){
+				auto& entry = slots[slot];
+				if( entry >= 0 && colours[entry] == colour )
+					return entry;
+				if( entry < 0 ){
+					if( colours.size() >= MAX_COLOURS )
+						return -1;
+					entry = colours.size();
+					colours.append( colour );
+					return entry;
+				}
+			}
+		}
+		
+		const QVector<QRgb>& table() const{ return colours; }
+};
+
+/** Convert an image to use a palette, if it has few enough colours.
+ *  The colours are kept exactly, including alpha.
+ *  \param [in] img The image to convert
+ *  \return The paletted image, or a null image if it has too many colours */
+static QImage to_indexed( const QImage& img ){
+	if( img.format() != QImage::Format_ARGB32 && img.format() != QImage::Format_RGB32 )
+		return {};
+	
+	QImage output( img.size(), QImage::Format_Indexed8 );
+	Palette palette;
+	for( int iy=0; iy<img.height(); iy++ ){
+		auto in  = (const QRgb*)img.constScanLine( iy );
+		auto out = output.scanLine( iy );
+		
+		//Neighbouring pixels often have the same colour, so skip the lookup
+		QRgb last = 0;
+		int last_index = -1;
+		for( int ix=0; ix<img.width(); ix++ ){
+			if( last_index < 0 || in[ix] != last ){
+				last = in[ix];
+				last_index = palette.index( last );
+				if( last_index < 0 )
+					return {};
+			}
+			out[ix] = last_index;
+		}
+	}
+	
+	output.setColorTable( palette.table() );
+	return output;
+}
+
+/** \return **img** in the cheapest representation for this format */
+QImage Format::prepare( QImage img ) const{
+	//Lossless webp already looks for a palette itself
+	if( format.toLower() == "png" ){
+		auto indexed = to_indexed( img );
+		if( !indexed.isNull() )
+			return indexed;
+	}
+	return img;
+}
+
 
 /** Compress image to a memory buffer
  *  
@@ -57,7 +138,7 @@ QByteArray Format::to_byte_array( QImage img ) const{
 	QByteArray data;
 	QBuffer buffer( &data );
 	buffer.open( QIODevice::WriteOnly );
-	img.save( &buffer, ext(), get_quality() );
+	prepare( img ).save( &buffer, ext(), get_quality() );
 	return data;
 }
 
@@ -66,7 +147,7 @@ bool Format::save( QImage img, QString path ) const{
 		qWarning( "RAW mode should not be saved, only available as to_byte_array()" );
 		return false;
 	}
-	return img.save( filename(path), ext(), get_quality() );
+	return prepare( img ).save( filename(path), ext(), get_quality() );
 }
 
 /** Estimate file size when compressed
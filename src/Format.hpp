@@ -28,6 +28,10 @@ class Format {
 		QByteArray format{ "png" }; ///file extension compatible with Qt format
 		int quality{ 100 }; ///Compression quality when saving
 		int precision_level{ 0 };
+		bool add_offset{ false }; ///Allow storing small colour changes in add-offset layers
+		bool virtual_ancestors{ false }; ///Allow branching frames from images which are not frames
+		
+		QImage prepare( QImage img ) const;
 		
 	public:
 		/** Everything set to default values */
@@ -65,6 +69,20 @@ class Format {
 		/** \return Current precision level */
 		int get_precision() const{ return precision_level; }
 		
+		/** \param [in] enabled Allow cgcompress:add-offset layers, which are not
+		 *  supported by the older decoders */
+		void set_add_offset( bool enabled ){ add_offset = enabled; }
+		
+		/** \return true if add-offset layers may be used */
+		bool get_add_offset() const{ return add_offset; }
+		
+		/** \param [in] enabled Search for virtual ancestors, which makes
+		 *  generating the differences slower */
+		void set_virtual_ancestors( bool enabled ){ virtual_ancestors = enabled; }
+		
+		/** \return true if virtual ancestors may be used */
+		bool get_virtual_ancestors() const{ return virtual_ancestors; }
+		
 		/** Create filename with a compatible extension
 		 *  \param [in] name Name of the file
 		 *  \return Name with extension
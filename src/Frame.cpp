@@ -17,18 +17,27 @@
 
 #include "Frame.hpp"
 
-/** \return The image this frame represent */
-Image Frame::reconstruct() const{
+/** \param [in] primitives The primitives the layers refer to
+ *  \return The image this frame represent */
+Image Frame::reconstruct( const QList<Image>& primitives ) const{
 	if( layers.size() == 0 )
 		return Image( QPoint(0,0), QImage() );
 	
-	Image image( primitives[layers[0]] );
-	for( int i=1; i<layers.size(); i++ )
-		image = image.combine( primitives[layers[i]] );
+	QRect area;
+	for( auto layer : layers )
+		area |= primitives[layer].get_rect();
+		
+	//Paint all layers on one canvas, so it is only allocated once
+	auto image = Image::canvas( area );
+	for( auto layer : layers )
+		image.blend( primitives[layer] );
 	return image;
 }
 
 void Frame::update_ids( int from, QList<int> to ){
+	if( !layers.contains( from ) )
+		return;
+	
 	QList<int> new_layers;
 	
 	for( auto layer : layers ){
@@ -41,26 +50,48 @@ void Frame::update_ids( int from, QList<int> to ){
 	layers = new_layers;
 }
 
-void Frame::remove_pointless_layers(){
-	//Final result, anything we do must not change this!
-	auto truth = reconstruct();
+/** Remove layers which do not change the reconstructed image
+ *  \param [in] primitives The primitives the layers refer to
+ *  \return The amount of layers removed */
+int Frame::remove_pointless_layers( const QList<Image>& primitives ){
+	QRect area;
+	for( auto layer : layers )
+		area |= primitives[layer].get_rect();
+	
+	//Find the pixels painted by the layers above each layer, within its own area
+	QList<BitMask> hidden;
+	BitMask covered( area.size() );
+	for( int i=layers.size()-1; i>=0; i-- ){
+		auto& image = primitives[layers[i]];
+		auto rect = image.get_rect().translated( -area.topLeft() );
+		hidden.prepend( covered.copy( rect.x(), rect.y(), rect.width(), rect.height() ) );
+		if( image.replaces_pixels() ) //Other modes depend on the pixels below
+			covered.combine( image.painted(), rect.x(), rect.y() );
+	}
 	
-	//Try to remove each layer one at a time
-	for( int k=1; k<layers.size(); k++ ){ //TODO: make it possible to remove the first layer as well
-		Image image( primitives[layers[0]] );
-		for( int i=1; i<layers.size(); i++ )
-			if( i != k && layers[i] != -1 )
-				image = image.combine( primitives[layers[i]] );
+	//Go through the layers bottom-up, keeping the composite of the kept layers.
+	//A layer is pointless if all the pixels it shows are either hidden by a
+	//later layer, or already have the same value in the composite.
+	auto composite = Image::canvas( area );
+	QList<int> kept;
+	for( int i=0; i<layers.size(); i++ ){
+		auto& image = primitives[layers[i]];
 		
-		//Did it cause any change? If not then we can remove it
-		if( image == truth ){
-			qDebug( "Found pointless layer %d", layers[k] );
-			layers[k] = -1;
-		}
+		//The remaining layers must still cover the same area
+		QRect rest;
+		for( auto layer : kept )
+			rest |= primitives[layer].get_rect();
+		for( int j=i+1; j<layers.size(); j++ )
+			rest |= primitives[layers[j]].get_rect();
+		
+		if( rest == area && image.replaces_pixels() && image.is_redundant( composite, hidden[i] ) )
+			continue;
+		
+		composite.blend( image );
+		kept << layers[i];
 	}
 	
-	//Properly remove the layers we marked as pointless
-	layers.removeAll( -1 );
+	int removed = layers.size() - kept.size();
+	layers = kept;
+	return removed;
 }
-
-
@@ -25,22 +25,17 @@
 /** A single frame in a multi image */
 class Frame {
 	public:
-		/// Images for reconstructing the original image
-		QList<Image> primitives;
-		
-		/// The indexes to primitives used for reconstructing
+		/// The indexes to the shared primitives used for reconstructing
 		QList<int> layers;
 		
-		/** \param [in] primitives The primitives used to build the frame
-		  * \param [in] layers The specific order of the primitives used */
-		Frame( QList<Image> primitives, QList<int> layers )
-			: primitives( primitives ), layers( layers ) { }
+		/** \param [in] layers The specific order of the primitives used */
+		Frame( QList<int> layers ) : layers( layers ) { }
 		
-		Image reconstruct() const;
+		Image reconstruct( const QList<Image>& primitives ) const;
 		
 		void update_ids( int from, QList<int> to );
 		
-		void remove_pointless_layers();
+		int remove_pointless_layers( const QList<Image>& primitives );
 };
 
 #endif
@@ -0,0 +1,89 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FrameCache.hpp"
+
+FrameCache::FrameCache( QList<Image> primitives, const QList<Frame>& frames, std::size_t budget )
+	:	primitives( primitives ), nodes( 1 ), budget( budget ) {
+	//Build the tree, counting how many frames pass through each node
+	std::vector<int> frame_count( 1, 0 );
+	for( auto& frame : frames ){
+		int node = 0;
+		for( auto layer : frame.layers ){
+			node = child( node, layer );
+			frame_count.resize( nodes.size(), 0 );
+			frame_count[node]++;
+		}
+	}
+	
+	//Cache nodes used by several frames, unless they all continue to the same node
+	for( unsigned i=1; i<nodes.size(); i++ ){
+		int continuing = 0;
+		for( auto next : nodes[i].children )
+			continuing += frame_count[next.second];
+		nodes[i].shared = frame_count[i] > 1 && (nodes[i].children.size() > 1 || continuing < frame_count[i]);
+	}
+}
+
+/** \return The index of the node for **layer** following **node**, created if missing */
+int FrameCache::child( int node, int layer ){
+	auto it = nodes[node].children.find( layer );
+	if( it != nodes[node].children.end() )
+		return it->second;
+	
+	int index = nodes.size();
+	nodes[node].children[layer] = index;
+	nodes.emplace_back();
+	return index;
+}
+
+/** Cache the composite for **node**, if it is within the memory budget */
+void FrameCache::store( int node, const Image& composite ){
+	auto size = std::size_t( composite.get_rect().width() ) * composite.get_rect().height() * sizeof(QRgb);
+	if( used + size > budget )
+		return;
+	
+	used += size;
+	nodes[node].composite = composite;
+}
+
+/** Reconstruct a frame, starting from the longest cached prefix
+ *  \param [in] layers The layers of the frame
+ *  \return The image the frame represents */
+Image FrameCache::reconstruct( const QList<int>& layers ){
+	//Find the longest cached prefix
+	Image image( QPoint(0,0), QImage() );
+	int start = 0, node = 0;
+	for( int i=0, current=0; i<layers.size(); i++ ){
+		current = child( current, layers[i] );
+		if( nodes[current].composite.is_valid() ){
+			image = nodes[current].composite;
+			start = i + 1;
+			node = current;
+		}
+	}
+	
+	//Blend the rest, caching where other frames can continue from
+	for( int i=start; i<layers.size(); i++ ){
+		node = child( node, layers[i] );
+		image.blend( primitives[layers[i]] );
+		if( nodes[node].shared )
+			store( node, image );
+	}
+	
+	return image;
+}
@@ -0,0 +1,67 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAME_CACHE_HPP
+#define FRAME_CACHE_HPP
+
+#include "Frame.hpp"
+#include "Image.hpp"
+
+#include <QList>
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+/** Reconstructs frames while reusing the composites of shared layer prefixes.
+ *  Frames from Converter::path() usually start with the same layers, so the
+ *  layer sequences form a tree. Composites are cached where the tree branches,
+ *  so reconstructing all frames only blends each edge of the tree once, as
+ *  long as the cached composites fit within the memory budget.
+ */
+class FrameCache{
+	public:
+		static const std::size_t DEFAULT_BUDGET = 256 * 1024 * 1024;
+		
+	private:
+		struct Node{
+			/// Layer id to node index
+			std::map<int,int> children;
+			/// Set if more than one frame continues from this node
+			bool shared{ false };
+			/// The composite of the layers up to this node, if cached
+			Image composite{ QPoint(0,0), QImage() };
+		};
+		
+		QList<Image> primitives;
+		std::vector<Node> nodes;
+		std::size_t budget;
+		std::size_t used{ 0 };
+		
+		int child( int node, int layer );
+		void store( int node, const Image& composite );
+		
+	public:
+		/** \param [in] primitives The primitives the frames use
+		 *  \param [in] frames The frames which are going to be reconstructed
+		 *  \param [in] budget Maximum amount of bytes used for cached composites */
+		FrameCache( QList<Image> primitives, const QList<Frame>& frames, std::size_t budget=DEFAULT_BUDGET );
+		
+		Image reconstruct( const QList<int>& layers );
+};
+
+#endif
@@ -0,0 +1,159 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FrameStore.hpp"
+#include "FileUtils.hpp"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QMutexLocker>
+
+FrameStore::FrameStore( QString dir ){
+	if( !QDir().mkpath( dir ) )
+		return;
+	data.setFileName(  QDir( dir ).filePath( "frames.raw"   ) );
+	index.setFileName( QDir( dir ).filePath( "frames.index" ) );
+	lock_path = QDir( dir ).filePath( "frames.lock" );
+	if( !data.open( QIODevice::ReadWrite ) || !index.open( QIODevice::ReadWrite ) )
+		return;
+	
+	QLockFile lock( lock_path );
+	valid = lock.lock() && read_index();
+}
+
+/** Add the index entries written since the last call, including those from
+ *  other processes. The store must be locked, as a partially written line
+ *  is removed.
+ *  \return true if the index could be read */
+bool FrameStore::read_index(){
+	if( !index.seek( index_read ) )
+		return false;
+	
+	//Each line is "offset<tab>width<tab>height<tab>key", frames are only added
+	//to the index after their pixels are written, so the index is never ahead
+	auto lines = index.readAll();
+	auto end = lines.lastIndexOf( '\n' ) + 1;
+	if( end < lines.size() ){
+		//Drop a partially written line from an interrupted run
+		if( !index.resize( index_read + end ) )
+			return false;
+		lines.truncate( end );
+	}
+	index_read += end;
+	
+	for( auto line : QString::fromUtf8( lines ).split( '\n', QString::SkipEmptyParts ) ){
+		auto parts = line.split( '\t' );
+		if( parts.size() < 4 )
+			continue;
+		
+		Frame frame{ parts[0].toLongLong(), { parts[1].toInt(), parts[2].toInt() } };
+		auto id = line.section( '\t', 3 );
+		if( frame.offset + qint64(frame.size.width()) * frame.size.height() * 4 <= data.size() && !frames.contains( id ) )
+			frames.insert( id, frame );
+	}
+	
+	return index.seek( index.size() );
+}
+
+QString FrameStore::key( QString path, QString variant ){
+	//Not using arg(), as it would replace markers like %1 in the path
+	QFileInfo info( path );
+	return info.absoluteFilePath()
+		+	"|" + QString::number( info.size() )
+		+	"|" + QString::number( info.lastModified().toMSecsSinceEpoch() )
+		+	"|" + variant;
+}
+
+/** \return **frame** as a read-only image using the mapped file */
+QImage FrameStore::map( Frame& frame ){
+	auto w = frame.size.width(), h = frame.size.height();
+	if( !frame.pixels )
+		frame.pixels = data.map( frame.offset, qint64(w) * h * 4 );
+	if( !frame.pixels )
+		return {};
+	return QImage( frame.pixels, w, h, w * 4, QImage::Format_ARGB32 );
+}
+
+/** Append the pixels of **img** and then its index entry. Other processes
+ *  are kept from appending at the same time by locking the store.
+ *  \return true if the frame was added */
+bool FrameStore::write( QString id, const QImage& img ){
+	QLockFile lock( lock_path );
+	if( !lock.lock() || !read_index() )
+		return false;
+	
+	//Another process might have added it already
+	if( frames.contains( id ) )
+		return true;
+	
+	Frame frame{ data.size(), img.size() };
+	if( !data.seek( frame.offset ) )
+		return false;
+	for( int iy=0; iy<img.height(); iy++ ){
+		auto bytes = img.width() * 4;
+		if( data.write( (const char*)img.constScanLine( iy ), bytes ) != bytes )
+			return false;
+	}
+	//The pixels must be on the disk before the index refers to them
+	if( !sync_file( data ) )
+		return false;
+	
+	auto line = QString( "%1\t%2\t%3\t%4\n" )
+		.arg( frame.offset ).arg( img.width() ).arg( img.height() ).arg( id ).toUtf8();
+	auto index_end = index.size();
+	if( index.write( line ) != line.size() || !sync_file( index ) ){
+		//Do not leave a partial line which the next frame would be appended to
+		index.resize( index_end );
+		index.seek( index_end );
+		return false;
+	}
+	index_read = index_end + line.size();
+	
+	frames.insert( id, frame );
+	return true;
+}
+
+QImage FrameStore::load( QString path, QString variant, std::function<QImage()> decode ){
+	if( !valid )
+		return decode();
+	
+	auto id = key( path, variant );
+	{	QMutexLocker locker( &mutex );
+		auto found = frames.find( id );
+		if( found != frames.end() ){
+			auto img = map( *found );
+			if( !img.isNull() )
+				return img;
+		}
+	}
+	
+	//Decode without blocking the other threads
+	auto img = decode().convertToFormat( QImage::Format_ARGB32 );
+	if( img.isNull() )
+		return img;
+	
+	QMutexLocker locker( &mutex );
+	if( !frames.contains( id ) && !write( id, img ) ){
+		qWarning( "Could not add '%s' to the frame store", path.toLocal8Bit().constData() );
+		return img;
+	}
+	
+	auto mapped = map( frames[id] );
+	return mapped.isNull() ? img : mapped;
+}
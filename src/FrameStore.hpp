@@ -0,0 +1,75 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAME_STORE_HPP
+#define FRAME_STORE_HPP
+
+#include <QFile>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+
+#include <functional>
+
+/** A persistent cache of decoded input images, stored as raw ARGB32 pixels in
+ *  a flat file with a separate index. Cached images are memory-mapped instead
+ *  of decoded, so they are shared between threads and processes through the
+ *  page cache, and a restarted run does not need to decode them again.
+ *  
+ *  The images returned refer to the mapped file, so they must not outlive the
+ *  store. It is safe to load images from several threads, and several
+ *  processes can use the same store, as appending is done with a lock file. */
+class FrameStore{
+	private:
+		struct Frame{
+			qint64 offset;
+			QSize size;
+			const uchar* pixels{ nullptr }; ///< Mapped data, nullptr until needed
+		};
+		
+		QFile data;
+		QFile index;
+		QString lock_path;
+		qint64 index_read{ 0 }; ///< Bytes of **index** added to **frames**
+		QHash<QString, Frame> frames;
+		QMutex mutex;
+		bool valid{ false };
+		
+		bool read_index();
+		QImage map( Frame& frame );
+		bool write( QString id, const QImage& img );
+		
+	public:
+		/** Open the store in **dir**, creating it if it does not exist */
+		explicit FrameStore( QString dir );
+		
+		/** \return true if the store could be opened */
+		bool is_open() const{ return valid; }
+		
+		/** \return Identifies the contents of **path**, decoded using **variant** */
+		static QString key( QString path, QString variant );
+		
+		/** Load an image from the store, decoding and adding it if not stored yet
+		 *  \param [in] path The image file
+		 *  \param [in] variant Describes any processing **decode** does after decoding
+		 *  \param [in] decode Decodes the image if it is not in the store
+		 *  \return The image in ARGB32, or a null image if decoding failed */
+		QImage load( QString path, QString variant, std::function<QImage()> decode );
+};
+
+#endif
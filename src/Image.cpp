@@ -18,34 +18,79 @@
 #include "Image.hpp"
 #include "FileSizeEval.hpp"
 
+#include <algorithm>
 #include <cmath>
 
-#include <QPainter>
 #include <QBuffer>
 
 using namespace std;
 
 //static int guid = 0; //For saving debug images
 
-const auto TRANS_SET = qRgba( 255, 0, 255, 0 );
+using Blending::TRANS_SET;
 const auto TRANS_NONE = qRgba( 0, 0, 0, 0 );
 
 const auto PIXEL_DIFFERENT = 0; //Pixel do not match with other image
 const auto PIXEL_MATCH = 1;     //Pixel is the same as other image
 const auto PIXEL_SHARED = 2;    //Pixel is the same, but must not be set as it differ in another image
 
-static QImage make_mask( QSize size ){
-	QImage mask( size, QImage::Format_Indexed8 );
-	mask.setColor( PIXEL_MATCH, qRgb(255, 0, 0) );
-	mask.setColor( PIXEL_DIFFERENT, qRgb(0, 255, 0) );
-	mask.setColor( PIXEL_SHARED, qRgb(0, 0, 255) );
-	return mask;
+using Word = PixelMask::Word;
+
+/** \param [in] in1 A row of pixels
+ *  \param [in] in2 A row of pixels with the same width
+ *  \param [in] index Word in the mask to find the pixels for
+ *  \param [in] width The width of the rows
+ *  \return Slot mask of the pixels in the word which differ */
+static Word differing_pixels( const QRgb* in1, const QRgb* in2, int index, int width ){
+	Word slots = 0;
+	auto start = index * PixelMask::PER_WORD, end = min( start + PixelMask::PER_WORD, width );
+	for( int ix=start; ix<end; ix++ )
+		slots |= Word( in1[ix] != in2[ix] ) << ((ix - start) * 2);
+	return slots;
 }
 
+/** \return Slot mask of the pixels in **word** which are PIXEL_DIFFERENT */
+static Word set_pixels( const PixelMask& mask, const Word* row, int index )
+	{ return PixelMask::matches( row[index], PIXEL_DIFFERENT ) & mask.used( index ); }
+
 Image::Image( QPoint pos, QImage img )
-	:	img(img.convertToFormat(QImage::Format_ARGB32), pos), mask(make_mask(img.size()))
-{
-	mask.fill( PIXEL_DIFFERENT );
+	:	img(img.convertToFormat(QImage::Format_ARGB32), pos), mask(img.size(), PIXEL_DIFFERENT)
+	,	hashes( std::make_shared<LazyPixelHashes>() )
+	{ }
+
+/** Uses the row and tile hashes of two images to skip comparing pixels.
+ *  If one of the images does not have hashes, nothing is known about the rows.
+ *  Equal hashes are treated as equal pixels, the final output validation
+ *  guards against the (astronomically unlikely) collisions. */
+class RowMatcher{
+	private:
+		const PixelHashes* first { nullptr };
+		const PixelHashes* second{ nullptr };
+		
+	public:
+		RowMatcher() { }
+		RowMatcher( const PixelHashes& first, const PixelHashes& second )
+			: first(&first), second(&second) { }
+		
+		/** \return true if row **iy** is known to be identical */
+		bool equal( int iy ) const
+			{ return first && first->row( iy ) == second->row( iy ); }
+		
+		/** \return true if row **iy** is known to differ */
+		bool differs( int iy ) const
+			{ return first && first->row( iy ) != second->row( iy ); }
+		
+		/** \return true if the tile containing **ix**,**iy** is known to be identical */
+		bool tile_equal( int ix, int iy ) const
+			{ return first && first->tile( ix, iy ) == second->tile( ix, iy ); }
+};
+
+/** \param [in] other Image with the same dimensions
+ *  \return A RowMatcher for comparing the pixels of this and **other** */
+RowMatcher Image::row_matcher( const Image& other ) const{
+	if( !hashes || !other.hashes || img.size() != other.img.size() )
+		return {};
+	return { hashes->get( img ), other.hashes->get( other.img ) };
 }
 
 /** Create a resized version of this image, will keep aspect ratio
@@ -149,21 +194,103 @@ QList<Image> Image::diff_segment( Image diff ) const{
 }
 */
 
+/** Create an empty canvas to paint on
+ *  \param [in] area The area the canvas covers
+ *  \return A canvas where all pixels are shown and fully transparent */
+Image Image::canvas( QRect area ){
+	QImage data( area.size(), QImage::Format_ARGB32 );
+	data.fill( 0 );
+	Image canvas( SubQImage( data, area.topLeft() ), PixelMask( area.size(), PIXEL_DIFFERENT ), std::make_shared<LazyPixelHashes>() );
+	canvas.is_canvas = true;
+	return canvas;
+}
+
+/** Paint another image on top of this one using its blend mode, modifying
+ *  this image. This is done in place if **on_top** is within a canvas,
+ *  otherwise this image is first painted on a new canvas covering both images.
+ *  \param [in] on_top Image to paint */
+void Image::blend( const Image& on_top ){
+	if( !on_top.is_valid() )
+		return;
+		
+	auto area = get_rect();
+	bool in_place = is_valid()
+		&&	is_canvas
+		&&	area.contains( on_top.get_rect() )
+		&&	mask.count( PIXEL_DIFFERENT ) == area.width() * area.height()
+		;
+	if( !in_place ){
+		auto grown = canvas( is_valid() ? area | on_top.get_rect() : on_top.get_rect() );
+		grown.blend( with_mode( Blending::Mode::ALPHA_REPLACE ) );
+		*this = std::move( grown );
+	}
+	
+	auto offset = on_top.get_pos() - get_pos();
+	for( int iy=0; iy<on_top.img.height(); iy++ )
+		Blending::blend_row( on_top.mode
+			,	img.writableRow( iy + offset.y() ) + offset.x()
+			,	on_top.img.row( iy )
+			,	on_top.mask.isNull() ? nullptr : on_top.mask.constRow( iy )
+			,	PIXEL_DIFFERENT
+			,	on_top.img.width()
+			);
+			
+	//The pixel data changed
+	saved_data = QByteArray();
+	hashes = std::make_shared<LazyPixelHashes>();
+}
+
 /** Paint another image on top of this one
- *  \param [in] on_top Image to paint
+ *  \param [in] on_top Image to paint, using its blend mode
  *  \return The combined image */
 Image Image::combine( Image on_top ) const{
-	QPoint tl{ min( get_pos().x(), on_top.get_pos().x() ), min( get_pos().y(), on_top.get_pos().y() ) };
-	int width  = max( get_pos().x()+img.width(),  on_top.get_pos().x()+on_top.img.width() )  - tl.x();
-	int height = max( get_pos().y()+img.height(), on_top.get_pos().y()+on_top.img.height() ) - tl.y();
+	auto output = canvas( get_rect() | on_top.get_rect() );
+	output.blend( with_mode( Blending::Mode::ALPHA_REPLACE ) );
+	output.blend( on_top );
+	return output;
+}
+
+/** \return The pixels which would be changed by painting this image with alpha-replace */
+BitMask Image::painted() const{
+	BitMask out( img.size() );
+	for( int iy=0; iy<img.height(); iy++ ){
+		auto in = img.row( iy );
+		auto in_mask = mask.isNull() ? nullptr : mask.constRow( iy );
+		out.setRow( iy, [&]( int ix ){
+				return (!in_mask || PixelMask::get( in_mask, ix ) == PIXEL_DIFFERENT) && in[ix] != TRANS_SET;
+			} );
+	}
+	return out;
+}
+
+/** Check if painting this image with alpha-replace would change **canvas**
+ *  \param [in] canvas The image to paint on, must contain this image
+ *  \param [in] hidden Pixels which do not matter, with the size of this image
+ *  \return true if no pixels outside **hidden** would change */
+bool Image::is_redundant( const Image& canvas, const BitMask& hidden ) const{
+	auto offset = get_pos() - canvas.get_pos();
+	auto painted_pixels = painted();
 	
-	QImage output( width, height, QImage::Format_ARGB32 );
-	output.fill( 0 );
-	QPainter painter( &output ); //TODO: support cgcompress:alpha-replace
-	painter.drawImage(        get_pos()-tl,        remove_transparent() );
-	painter.drawImage( on_top.get_pos()-tl, on_top.remove_transparent() );
+	for( int iy=0; iy<img.height(); iy++ ){
+		auto in  = img.row( iy );
+		auto out = canvas.img.row( iy + offset.y() ) + offset.x();
+		auto in_painted = painted_pixels.constRow( iy );
+		auto in_hidden  = hidden.constRow( iy );
+		
+		for( int i=0; i<painted_pixels.words(); i++ ){
+			//Only pixels which are painted and visible matters
+			auto visible = in_painted[i] & ~in_hidden[i];
+			if( visible == 0 )
+				continue;
+			
+			auto start = i * BitMask::PER_WORD;
+			for( int ix=start; ix<min( start + BitMask::PER_WORD, img.width() ); ix++ )
+				if( BitMask::get( in_painted, ix ) && !BitMask::get( in_hidden, ix ) && in[ix] != out[ix] )
+					return false;
+		}
+	}
 	
-	return Image( tl, output ); //TODO:
+	return true;
 }
 
 /** The difference between the two images
@@ -173,18 +300,141 @@ Image Image::difference( Image input ) const{
 	//TODO: images must be the same size and at same point
 	
 	auto w = img.width();
-	auto mask = make_mask( img.size() );
+	PixelMask mask( img.size() );
+	auto matcher = row_matcher( input );
 	for( int iy=0; iy<img.height(); iy++ ){
 		auto out      =       img.row( iy );
 		auto in       = input.img.row( iy );
-		auto out_mask = mask.scanLine( iy );
-		for( int ix=0; ix<w; ix++ )
-			out_mask[ix] = (in[ix] == out[ix]) ? PIXEL_MATCH : PIXEL_DIFFERENT;
+		auto out_mask = mask.row( iy );
+		auto same_row = matcher.equal( iy );
+		for( int i=0; i<mask.words(); i++ ){
+			auto different = same_row ? 0 : differing_pixels( in, out, i, w );
+			out_mask[i] = PixelMask::spread( mask.used( i ) & ~different, PIXEL_MATCH );
+		}
 	}
 	
 	return input.newMask( mask );
 }
 
+/** Find the area where two images differ, without building a mask.
+ *  Rows are compared as a whole first, so only the rows which differ are
+ *  scanned pixel by pixel, and only outside the area already found.
+ *  \param [in] input The image to compare with, must have same dimensions
+ *  \return The smallest rectangle containing all differences, or an empty
+ *           rectangle if the images are identical */
+QRect Image::difference_bounds( Image input ) const{
+	//TODO: images must be the same size and at same point
+	auto w = img.width(), h = img.height();
+	auto matcher = row_matcher( input );
+	auto row_equal = [&]( int iy ){
+			if( matcher.equal( iy ) || matcher.differs( iy ) )
+				return matcher.equal( iy );
+			return std::equal( img.row( iy ), img.row( iy ) + w, input.img.row( iy ) );
+		};
+	
+	//Find first and last row with a difference
+	int top = 0, bottom = h-1;
+	for( ; top    <  h   && row_equal( top    ); top++    );
+	for( ; bottom >= top && row_equal( bottom ); bottom-- );
+	if( top > bottom )
+		return {};
+	
+	//Narrow down columns, only checking outside the current bounds
+	const auto tile = PixelHashes::TILE_SIZE;
+	int left = w, right = -1;
+	for( int iy=top; iy<=bottom; iy++ ){
+		if( matcher.equal( iy ) )
+			continue;
+		
+		auto out = img.row( iy );
+		auto in  = input.img.row( iy );
+		
+		//Tiles with equal hashes are skipped as a whole
+		for( int ix=0; ix<left; ix++ ){
+			if( matcher.tile_equal( ix, iy ) )
+				ix = (ix / tile + 1) * tile - 1;
+			else if( out[ix] != in[ix] ){
+				left = ix;
+				break;
+			}
+		}
+		for( int ix=w-1; ix>right; ix-- ){
+			if( matcher.tile_equal( ix, iy ) )
+				ix = (ix / tile) * tile;
+			else if( out[ix] != in[ix] ){
+				right = ix;
+				break;
+			}
+		}
+	}
+	
+	return QRect( QPoint( left, top ), QPoint( right, bottom ) );
+}
+
+/** The difference between the two images, cropped to the changed area.
+ *  Equivalent to difference( input ).auto_crop(), but the mask is only
+ *  created for the area which actually differs.
+ *  \param [in] input The image to diff on, must have same dimensions
+ *  \return The cropped difference */
+Image Image::difference_cropped( Image input ) const{
+	auto bounds = difference_bounds( input );
+	if( bounds.isEmpty() )
+		return input.sub_image( 0, 0, 0, 0 );
+	
+	auto w = bounds.width();
+	PixelMask mask( bounds.size() );
+	auto matcher = row_matcher( input );
+	for( int iy=0; iy<bounds.height(); iy++ ){
+		auto out      =       img.row( iy + bounds.y() ) + bounds.x();
+		auto in       = input.img.row( iy + bounds.y() ) + bounds.x();
+		auto out_mask = mask.row( iy );
+		auto same_row = matcher.equal( iy + bounds.y() );
+		for( int i=0; i<mask.words(); i++ ){
+			auto different = same_row ? 0 : differing_pixels( in, out, i, w );
+			out_mask[i] = PixelMask::spread( mask.used( i ) & ~different, PIXEL_MATCH );
+		}
+	}
+	
+	return Image( input.img.copy( bounds.topLeft(), bounds.size() ), mask );
+}
+
+
+/** Split the difference to another image into a layer adding small colour
+ *  shifts and a layer replacing the pixels which change too much.
+ *  Painting both on top of this image, offset first, results in **input**.
+ *  \param [in] input The image to diff on, must have same dimensions
+ *  \param [in] max_diff The largest channel difference stored in the offset layer
+ *  \return The two layers, the offset is invalid if no pixels differ */
+OffsetImage Image::offset_difference( Image input, int max_diff ) const{
+	OffsetImage result;
+	auto bounds = difference_bounds( input );
+	if( bounds.isEmpty() ){
+		result.overlay = difference( input );
+		return result;
+	}
+	
+	auto offset = canvas( bounds );
+	PixelMask overlay( img.size(), PIXEL_MATCH );
+	for( int iy=bounds.top(); iy<=bounds.bottom(); iy++ ){
+		auto top    = input.img.row( iy );
+		auto bottom =       img.row( iy );
+		auto out = offset.img.writableRow( iy - bounds.y() );
+		
+		for( int ix=bounds.left(); ix<=bounds.right(); ix++ ){
+			if( Blending::max_channel_difference( top[ix], bottom[ix] ) <= max_diff )
+				out[ix - bounds.x()] = Blending::get_offset( top[ix], bottom[ix] );
+			else{
+				out[ix - bounds.x()] = Blending::OFFSET_NEUTRAL;
+				overlay.set( ix, iy, PIXEL_DIFFERENT );
+			}
+		}
+	}
+	
+	result.offset  = offset.with_mode( Blending::Mode::ADD_OFFSET );
+	result.overlay = input.newMask( overlay );
+	return result;
+}
+
 
 /** Try to reset alpha to find an image which can simulate both images
  *  \param [in] input Another image
@@ -195,38 +445,38 @@ Image Image::contain_both( Image input ) const{
 		return Image( {0,0}, QImage() );
 	//TODO: Check the behaviour of this
 	
-	QImage mask_output( mask );
+	PixelMask mask_output( mask );
+	auto matcher = row_matcher( input );
+	auto w = mask.width();
 	
 	for( int iy=0; iy<mask.height(); iy++ ){
 		auto in1 =       img.row( iy );
 		auto in2 = input.img.row( iy );
+		auto same_row = matcher.equal( iy );
 		
-		auto mask1 =       mask.constScanLine( iy );
-		auto mask2 = input.mask.constScanLine( iy );
-		auto mask_out = mask_output.scanLine( iy );
+		auto mask1 =       mask.constRow( iy );
+		auto mask2 = input.mask.constRow( iy );
+		auto mask_out = mask_output.row( iy );
 		
-		for( int ix=0; ix<mask.width(); ix++ ){
-			auto pix1 = mask1[ix];
-			auto pix2 = mask2[ix];
-			auto& out = mask_out[ix];
+		//Each word contains 32 pixels, handled in parallel using slot masks
+		for( int i=0; i<mask.words(); i++ ){
+			auto used = mask.used( i );
+			auto pix1 = mask1[i], pix2 = mask2[i];
+			auto different = same_row ? 0 : differing_pixels( in1, in2, i, w );
+			auto set1 = set_pixels( mask, mask1, i ), set2 = set_pixels( mask, mask2, i );
 			
-			if( in1[ix] != in2[ix] ){
-				//Pixel cannot be shared
-				if( pix1 == PIXEL_DIFFERENT || pix2 == PIXEL_DIFFERENT )
-					return Image( {0,0}, QImage() );
-				
-				out = PIXEL_SHARED;
-			}
-			else{
-				if( pix1 == pix2 ) //No need to change
-					out = pix1;
-				else if( pix1 == PIXEL_MATCH ) //Other is the more specific
-					out = pix2;
-				else if( pix2 == PIXEL_MATCH ) //Other is the more specific
-					out = pix1;
-				else //One is shared, other is set, not allowed
-					return Image( {0,0}, QImage() );
-			}
+			//Pixel cannot be shared
+			if( different & (set1 | set2) )
+				return Image( {0,0}, QImage() );
+			
+			//One is shared, other is set, not allowed
+			auto shared1 = PixelMask::matches( pix1, PIXEL_SHARED ), shared2 = PixelMask::matches( pix2, PIXEL_SHARED );
+			if( ~different & ((set1 & shared2) | (shared1 & set2)) )
+				return Image( {0,0}, QImage() );
+			
+			//If one is PIXEL_MATCH, the other is the more specific. If equal, no need to change
+			auto out = PixelMask::select( PixelMask::matches( pix1, PIXEL_MATCH ), pix2, pix1 );
+			mask_out[i] = PixelMask::select( different, PixelMask::spread( used, PIXEL_SHARED ), out );
 		}
 	}
 	
@@ -245,116 +495,280 @@ SplitImage Image::split_shared( Image input ) const{
 	
 	
 	//Find the shared area of the two images
-	QImage mask_shared( mask );
+	PixelMask mask_shared( mask.size() );
+	auto matcher = row_matcher( input );
+	auto w = mask.width();
 	for( int iy=0; iy<mask.height(); iy++ ){
 		auto in1 =       img.row( iy );
 		auto in2 = input.img.row( iy );
+		auto same_row = matcher.equal( iy );
 		
-		auto mask1 =       mask.constScanLine( iy );
-		auto mask2 = input.mask.constScanLine( iy );
-		auto mask_out = mask_shared.scanLine( iy );
+		auto mask1 =       mask.constRow( iy );
+		auto mask2 = input.mask.constRow( iy );
+		auto mask_out = mask_shared.row( iy );
 		
-		for( int ix=0; ix<mask.width(); ix++ ){
-			auto mask_match = (mask1[ix] == mask2[ix]) && (mask2[ix] == PIXEL_DIFFERENT);
-			auto pixels_match = in1[ix] == in2[ix];
-			
-			mask_out[ix] = ( mask_match && pixels_match ) ? PIXEL_DIFFERENT : PIXEL_SHARED;
+		for( int i=0; i<mask.words(); i++ ){
+			auto mask_match = set_pixels( mask, mask1, i ) & set_pixels( mask, mask2, i );
+			auto pixels_match = same_row ? mask.used( i ) : ~differing_pixels( in1, in2, i, w );
+			mask_out[i] = PixelMask::spread( mask.used( i ) & ~( mask_match & pixels_match ), PIXEL_SHARED );
 		}
 	}
 	
 	//Function for removing the shared areas of the masks
-	auto cut_mask = []( QImage mask, QImage cut ){
+	auto cut_mask = []( PixelMask mask, const PixelMask& cut ){
 			for( int iy=0; iy<mask.height(); iy++ ){
-				auto r_out = mask.     scanLine( iy );
-				auto r_cut = cut .constScanLine( iy );
+				auto r_out = mask.row( iy );
+				auto r_cut = cut.constRow( iy );
 				
-				for( int ix=0; ix<mask.width(); ix++ )
-					r_out[ix] = (r_cut[ix] == PIXEL_DIFFERENT) ? PIXEL_SHARED : r_out[ix];
+				for( int i=0; i<mask.words(); i++ )
+					r_out[i] = PixelMask::select( set_pixels( cut, r_cut, i ), PixelMask::spread( mask.used( i ), PIXEL_SHARED ), r_out[i] );
 			}
 			return mask;
 		};
 	
 	SplitImage result;
-	result.shared = Image( this->img, mask_shared );
-	result.first  = Image( this->img, cut_mask( this->mask, mask_shared ) );
-	result.second = Image( input.img, cut_mask( input.mask, mask_shared ) );
+	result.shared = Image( this->img, mask_shared, this->hashes );
+	result.first  = Image( this->img, cut_mask( this->mask, mask_shared ), this->hashes );
+	result.second = Image( input.img, cut_mask( input.mask, mask_shared ), input.hashes );
 	result.usefulness = -1;
 	
 	return result;
 }
 
+/** Find the pixels which could be shared with another image, like split_shared()
+ *  \param [in] other Image with the same size and position
+ *  \return The pixels shown in both images with the same value */
+BitMask Image::shared_pixels( const Image& other ) const{
+	if( mask.isNull() || other.mask.isNull() )
+		return {};
+	
+	BitMask shared( mask.size() );
+	auto matcher = row_matcher( other );
+	for( int iy=0; iy<mask.height(); iy++ ){
+		auto in1 =       img.row( iy );
+		auto in2 = other.img.row( iy );
+		auto same_row = matcher.equal( iy );
+		auto mask1 =       mask.constRow( iy );
+		auto mask2 = other.mask.constRow( iy );
+		
+		shared.setRow( iy, [&]( int ix ){
+				return PixelMask::get( mask1, ix ) == PIXEL_DIFFERENT
+					&& PixelMask::get( mask2, ix ) == PIXEL_DIFFERENT
+					&& (same_row || in1[ix] == in2[ix]);
+			} );
+	}
+	
+	return shared;
+}
+
+/** \param [in] area The pixels to keep, with the same size as this image
+ *  \return This image, but only showing the pixels in **area** */
+Image Image::only_pixels( const BitMask& area ) const{
+	PixelMask out( mask.size() );
+	for( int iy=0; iy<mask.height(); iy++ ){
+		auto in = area.constRow( iy );
+		out.setRow( iy, [&]( int ix ){ return BitMask::get( in, ix ) ? PIXEL_DIFFERENT : PIXEL_SHARED; } );
+	}
+	return newMask( out );
+}
+
+/** \param [in] area The pixels to hide, with the same size as this image
+ *  \return This image, where the pixels in **area** must not be shown */
+Image Image::without_pixels( const BitMask& area ) const{
+	auto out = mask;
+	for( int iy=0; iy<mask.height(); iy++ ){
+		auto in = area.constRow( iy );
+		auto row = out.row( iy );
+		for( int i=0; i<mask.words(); i++ ){
+			Word slots = 0;
+			auto start = i * PixelMask::PER_WORD, end = min( start + PixelMask::PER_WORD, mask.width() );
+			for( int ix=start; ix<end; ix++ )
+				slots |= Word( BitMask::get( in, ix ) ) << ((ix - start) * PixelMask::BITS);
+			row[i] = PixelMask::select( slots, PixelMask::spread( slots, PIXEL_SHARED ), row[i] );
+		}
+	}
+	return newMask( out );
+}
+
+/** Summed-area table of the PIXEL_DIFFERENT pixels in a mask. Allows
+ *  counting the set pixels in any rectangle in constant time. */
+class MaskIntegral{
+	private:
+		std::vector<int> sums;
+		int width;
+		int height;
+		
+		int sum( int x, int y ) const{ return sums[ y*(width+1) + x ]; }
+		
+	public:
+		MaskIntegral( const PixelMask& mask )
+			:	sums( (mask.width()+1) * (mask.height()+1), 0 )
+			,	width( mask.width() ), height( mask.height() ) {
+			for( int iy=0; iy<height; iy++ ){
+				auto in = mask.constRow( iy );
+				auto above = sums.data() + iy*(width+1);
+				auto out = above + width + 1;
+				
+				int row_sum = 0;
+				for( int ix=0; ix<width; ix++ ){
+					row_sum += (PixelMask::get( in, ix ) == PIXEL_DIFFERENT) ? 1 : 0;
+					out[ix+1] = above[ix+1] + row_sum;
+				}
+			}
+		}
+		
+		/** \return The amount of set pixels in the square around **x**,**y**
+		 *  which extends **half** pixels in each direction */
+		int count( int x, int y, int half ) const{
+			auto x1 = std::max( x - half, 0 ), x2 = std::min( x + half + 1, width  );
+			auto y1 = std::max( y - half, 0 ), y2 = std::min( y + half + 1, height );
+			return sum( x2, y2 ) - sum( x1, y2 ) - sum( x2, y1 ) + sum( x1, y1 );
+		}
+};
+
+/** Set PIXEL_MATCH pixels to PIXEL_DIFFERENT if the surrounding area has
+ *  more set pixels than a threshold
+ *  \param [in] mask The mask to clean
+ *  \param [in] integral MaskIntegral of **mask**
+ *  \param [in] half How far the area extends in each direction
+ *  \param [in] threshold The amount of pixels which must be exceeded
+ *  \return The cleaned mask */
+static PixelMask clean_mask( const PixelMask& mask, const MaskIntegral& integral, int half, int threshold ){
+	PixelMask output( mask.size() );
+	for( int iy=0; iy<output.height(); iy++ ){
+		auto in = mask.constRow( iy );
+		output.setRow( iy, [&]( int ix ){
+				auto pixel = PixelMask::get( in, ix );
+				if( pixel == PIXEL_MATCH && integral.count( ix, iy, half ) > threshold )
+					return unsigned( PIXEL_DIFFERENT );
+				return pixel;
+			} );
+	}
+	return output;
+}
+
 /** Dilate the alpha channel to reduce salt&pepper noise
  *  \param [in] kernel_size How large area around each pixel should be considered
  *  \param [in] threshold How many pixels in the area must be set to enable this pixel
  *  \return The cleaned image */
 Image Image::clean_alpha( int kernel_size, int threshold ) const{
-	QImage output( mask );
-	int width = output.width(), height = output.height();
-	
-	std::vector<int> line( mask.width(), 0 );
-	int half = kernel_size / 2;
-	
-	//Add/Remove line 'iy' to cache
-	auto add    = [](int& val, unsigned char pix){ val = (pix == PIXEL_DIFFERENT) ? val+1 : val; };
-	auto remove = [](int& val, unsigned char pix){ val = (pix == PIXEL_DIFFERENT) ? val-1 : val; };
-	auto addLine = [&]( int iy ){
-			auto in = mask.constScanLine( iy );
-			for( int ix=0; ix<width; ix++ )
-				add( line[ix], in[ix] );
-		};
-	auto removeLine = [&]( int iy ){
-			auto in = mask.constScanLine( iy );
-			for( int ix=0; ix<width; ix++ )
-				remove( line[ix], in[ix] );
-		};
-	
-	//Initialize cache
-	for( int iy=0; iy<std::min(half,height); iy++ )
-		addLine( iy );
-	
-	for( int iy=0; iy<height; iy++ ){
-		auto out = output.scanLine( iy );
-		auto in  = mask.constScanLine( iy );
+	return newMask( clean_mask( mask, MaskIntegral( mask ), kernel_size / 2, threshold ) );
+}
+
+/** Evaluates clean_alpha() for every threshold of a kernel size at once.
+ *  The pixels a threshold enables is a subset of those enabled by any lower
+ *  threshold, so going from the highest to the lowest threshold only adds
+ *  pixels. This allows updating image_gradient_sum() incrementally. */
+class AlphaSweep{
+	private:
+		const SubQImage& img;
+		const PixelMask& mask;
+		MaskIntegral integral;
+		
+		/** \return Pixel indexes of changeable pixels, sorted by their count */
+		std::vector<std::vector<int>> buckets( int half ) const{
+			std::vector<std::vector<int>> out( (2*half+1)*(2*half+1) + 1 );
+			for( int iy=0; iy<mask.height(); iy++ ){
+				auto in = mask.constRow( iy );
+				for( int ix=0; ix<mask.width(); ix++ )
+					if( PixelMask::get( in, ix ) == PIXEL_MATCH )
+						out[ integral.count( ix, iy, half ) ].push_back( iy*mask.width() + ix );
+			}
+			return out;
+		}
 		
-		int kernel = 0;
-		for( int ix=0; ix<std::min(half,width); ix++ )
-			add( kernel, line[ix] );
+	public:
+		AlphaSweep( const SubQImage& img, const PixelMask& mask )
+			: img(img), mask(mask), integral(mask) { }
 		
-		for( int ix=0; ix<width; ix++ ){
-			if( in[ix] == PIXEL_MATCH )
-				if( kernel > threshold )
-					out[ix] = PIXEL_DIFFERENT;
-			
-			if( ix > 0 )
-				remove( kernel, in[ix-1] );
-			if( ix+1 < width )
-				add( kernel, in[ix+1] );
+		/** \param [in] half How far the area extends in each direction
+		 *  \param [in] threshold The amount of pixels which must be exceeded
+		 *  \return The mask clean_alpha() would produce */
+		PixelMask cleaned( int half, int threshold ) const
+			{ return clean_mask( mask, integral, half, threshold ); }
+		
+		/** \param [in] half How far the area extends in each direction
+		 *  \param [in] thresholds The amount of thresholds to evaluate
+		 *  \return The amount of pixels enabled by each threshold in [0,thresholds) */
+		std::vector<int> changed( int half, int thresholds ) const{
+			auto sorted = buckets( half );
+			std::vector<int> amounts( thresholds, 0 );
+			for( int j=0; j<thresholds; j++ )
+				for( unsigned count=j+1; count<sorted.size(); count++ )
+					amounts[j] += sorted[count].size();
+			return amounts;
 		}
 		
-		if( iy > 0 )
-			removeLine( iy-1 );
-		if( iy+1 < height )
-			addLine( iy+1 );
-	}
+		/** \param [in] half How far the area extends in each direction
+		 *  \param [in] thresholds The amount of thresholds to evaluate
+		 *  \param [in] base image_gradient_sum() of the mask without changes
+		 *  \return image_gradient_sum() for each threshold in [0,thresholds) */
+		std::vector<int> gradient_sums( int half, int thresholds, int base ) const{
+			auto sorted = buckets( half );
+			auto width = mask.width();
 			
-	return newMask( output );
-}
+			std::vector<uint8_t> shown( width * mask.height() );
+			for( int iy=0; iy<mask.height(); iy++ ){
+				auto in = mask.constRow( iy );
+				for( int ix=0; ix<width; ix++ )
+					shown[iy*width + ix] = PixelMask::get( in, ix ) == PIXEL_DIFFERENT;
+			}
+			
+			int current = base;
+			auto enable = [&]( int index ){
+					int ix = index % width, iy = index / width;
+					auto row = img.row( iy );
+					auto set = shown.data() + iy*width;
+					auto pairs = [&](){
+							int cost = 0;
+							if( ix > 0 )
+								cost += FileSize::gradient_pair( row[ix-1], set[ix-1], row[ix], set[ix] );
+							if( ix+1 < width )
+								cost += FileSize::gradient_pair( row[ix], set[ix], row[ix+1], set[ix+1] );
+							return cost;
+						};
+					
+					current -= pairs();
+					set[ix] = true;
+					current += pairs();
+				};
+			
+			//Going from the highest threshold down, each step enables one more bucket
+			std::vector<int> sums( thresholds, base );
+			for( int count=sorted.size()-1; count>0; count-- ){
+				for( auto index : sorted[count] )
+					enable( index );
+				if( count-1 < thresholds )
+					sums[count-1] = current;
+			}
+			return sums;
+		}
+};
 
 /** \return This image where all transparent pixels are set to transparent black **/
 QImage Image::remove_transparent() const{
-	if( mask.isNull() )
+	if( mask.isNull() || mask.count( PIXEL_DIFFERENT ) == mask.width() * mask.height() )
 		return qimg(); //Nothing is transparent
 	
 	QImage output( qimg() );
 	int width = output.width(), height = output.height();
+	//Hidden pixels must not change anything when adding offsets
+	auto hidden = (mode == Blending::Mode::ADD_OFFSET) ? Blending::OFFSET_NEUTRAL : TRANS_SET;
 	
 	for( int iy=0; iy<height; iy++ ){
 		auto out = (QRgb*)output.scanLine( iy );
-		auto out_mask = mask.constScanLine( iy );
+		auto out_mask = mask.constRow( iy );
+		
+		for( int i=0; i<mask.words(); i++ ){
+			//Skip words where all pixels are set
+			if( set_pixels( mask, out_mask, i ) == mask.used( i ) )
+				continue;
 			
-		for( int ix=0; ix<width; ix++ )
-			if( out_mask[ix] != PIXEL_DIFFERENT )
-				out[ix] = TRANS_SET;
+			auto start = i * PixelMask::PER_WORD;
+			for( int ix=start; ix<min( start + PixelMask::PER_WORD, width ); ix++ )
+				if( PixelMask::get( out_mask, ix ) != PIXEL_DIFFERENT )
+					out[ix] = hidden;
+		}
 	}
 	
 	return output;
@@ -363,26 +777,38 @@ QImage Image::remove_transparent() const{
 struct ContentMap{
 	std::vector<uint8_t> hor;
 	std::vector<uint8_t> ver;
-	ContentMap( QImage mask );
+	ContentMap( const PixelMask& mask );
 };
 
-	ContentMap::ContentMap( QImage mask )
+	ContentMap::ContentMap( const PixelMask& mask )
 		:	hor( mask.width(), false )
 		,	ver( mask.height(), false ){
 		
-		auto w = mask.width(), h = mask.height();
-		for( int iy=0; iy<h; iy++ ){
-			auto row = mask.constScanLine( iy );
-			for( int ix=0; ix<w; ix++ )
-				if( row[ix] == PIXEL_DIFFERENT )
-					hor[ix] = ver[iy] = true;
+		//Find columns by combining the rows one word at a time
+		std::vector<Word> columns( mask.words(), 0 );
+		for( int iy=0; iy<mask.height(); iy++ ){
+			auto row = mask.constRow( iy );
+			Word any = 0;
+			for( int i=0; i<mask.words(); i++ ){
+				auto set = set_pixels( mask, row, i );
+				columns[i] |= set;
+				any |= set;
+			}
+			ver[iy] = any != 0;
 		}
+		
+		for( int ix=0; ix<mask.width(); ix++ )
+			hor[ix] = PixelMask::get( columns.data(), ix ) != 0;
 	}
 /** \return This image, but with image data cropped to only contain non-transparent areas */
 Image Image::auto_crop() const{
 	if( mask.isNull() )
 		return *this;
 	
+	//Nothing to crop if every pixel is shown
+	if( mask.count( PIXEL_DIFFERENT ) == mask.width() * mask.height() )
+		return *this;
+	
 	//Build up lookup for horizontal and vertical lines
 	ContentMap map( mask );
 	
@@ -405,13 +831,7 @@ Image Image::optimize_filesize( Format format ) const{
 	auto copy = auto_crop();
 	
 	//skip images with no transparency
-	unsigned changeable = 0;
-	for( int iy=0; iy<copy.mask.height(); iy++ ){
-		auto row = copy.mask.constScanLine( iy );
-		for( int ix=0; ix<copy.mask.width(); ix++ )
-			if( row[ix] == PIXEL_MATCH )
-				changeable++;
-	}
+	unsigned changeable = copy.mask.count( PIXEL_MATCH );
 	if( changeable == 0 )
 		return copy;
 	
@@ -419,15 +839,48 @@ Image Image::optimize_filesize( Format format ) const{
 	Image best = copy;
 	int best_size = best.compressed_size( format, Format::MEDIUM );
 	
-	for( int i=0; i<7; i++ )
-		for( int j=0; j<i*i; j++ ){
-			Image current = copy.clean_alpha( i, j );
-			int size = current.compressed_size( format, Format::MEDIUM );
+	//Kernel sizes sharing the same half size give the same counts, so each
+	//half is only evaluated once for the highest threshold needed
+	const int kernels = 7;
+	auto thresholds = []( int kernel_size ){ return kernel_size * kernel_size; };
+	std::vector<int> max_thresholds( kernels/2 + 1, 0 );
+	for( int i=0; i<kernels; i++ )
+		max_thresholds[i/2] = std::max( max_thresholds[i/2], thresholds( i ) );
+	
+	AlphaSweep sweep( copy.img, copy.mask );
+	std::vector<std::vector<int>> sizes;
+	for( int half=0; half<int(max_thresholds.size()); half++ ){
+		if( format.get_precision() > 0 ) //Estimate is image_gradient_sum(), update it incrementally
+			sizes.push_back( sweep.gradient_sums( half, max_thresholds[half], best_size ) );
+		else{
+			//Only compress each distinct mask once
+			auto changed = sweep.changed( half, max_thresholds[half] );
+			std::vector<int> half_sizes( changed.size(), best_size );
+			for( unsigned j=0; j<changed.size(); j++ ){
+				if( changed[j] == 0 )
+					continue;
+				if( j > 0 && changed[j] == changed[j-1] )
+					half_sizes[j] = half_sizes[j-1];
+				else
+					half_sizes[j] = copy.newMask( sweep.cleaned( half, j ) ).compressed_size( format, Format::MEDIUM );
+			}
+			sizes.push_back( half_sizes );
+		}
+	}
+	
+	//Pick the best, in the same order as evaluating each clean_alpha() separately
+	int best_half = -1, best_threshold = -1;
+	for( int i=0; i<kernels; i++ )
+		for( int j=0; j<thresholds( i ); j++ ){
+			int size = sizes[i/2][j];
 			if( size < best_size ){
 				best_size = size;
-				best = current;
+				best_half = i/2;
+				best_threshold = j;
 			}
 		}
+	if( best_half >= 0 )
+		best = copy.newMask( sweep.cleaned( best_half, best_threshold ) );
 	
 	//Make sure filtering actually improved the situation
 	if( copy.save_compressed_size( format ) > best.save_compressed_size( format ) )
@@ -463,14 +916,19 @@ int Image::alpha_count() const{
 	if( mask.isNull() )
 		qFatal( "Image::alpha_count() not implemented for RGB" );
 	
-	int count = 0;
-	for( int iy=0; iy<mask.height(); iy++ ){
-		auto row = mask.scanLine( iy );
-		for( int ix=0; ix<mask.width(); ix++ )
-			count += (row[ix] == PIXEL_DIFFERENT) ? 1 : 0;
-	}
-	
-	return count;
+	return mask.count( PIXEL_DIFFERENT );
+}
+
+/** Count the shown pixels in square tiles, used for bounding how many pixels
+ *  two images can have in common.
+ *  \param [in] size The width and height of the tiles
+ *  \return The amount of shown pixels in each tile, row by row */
+std::vector<int> Image::shown_per_tile( int size ) const{
+	std::vector<int> counts;
+	for( int y=0; y<mask.height(); y+=size )
+		for( int x=0; x<mask.width(); x+=size )
+			counts.push_back( mask.count( PIXEL_DIFFERENT, x, y, min( size, mask.width()-x ), min( size, mask.height()-y ) ) );
+	return counts;
 }
 
 bool Image::mustKeepAlpha() const{
@@ -492,13 +950,11 @@ bool Image::mustKeepAlpha() const{
 
 
 Image Image::fromTransparent( QImage img ){
-	auto mask = make_mask( img.size() );
+	PixelMask mask( img.size() );
 	
 	for( int iy=0; iy<img.height(); iy++ ){
-		auto out = mask.scanLine( iy );
 		auto in = (const QRgb*)img.constScanLine( iy );
-		for( int ix=0; ix<img.width(); ix++ )
-			out[ix] = (qAlpha(in[ix]) != 0) ? PIXEL_DIFFERENT : PIXEL_MATCH;
+		mask.setRow( iy, [&]( int ix ){ return (qAlpha(in[ix]) != 0) ? PIXEL_DIFFERENT : PIXEL_MATCH; } );
 	}
 	
 	return Image( img ).newMask( mask );
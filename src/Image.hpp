@@ -22,16 +22,36 @@
 #include <QImage>
 #include <QByteArray>
 
+#include "Blending.hpp"
 #include "Format.hpp"
+#include "PackedMask.hpp"
+#include "PixelHashes.hpp"
 #include "SubQImage.hpp"
 
+#include <memory>
+#include <vector>
+
+class RowMatcher;
+
 class Image {
 	private:
 		SubQImage img;
-		QImage mask;
+		PixelMask mask;
 		
 		QByteArray saved_data;
 		
+		/// Row hashes of **img**, shared with all images using the same data
+		std::shared_ptr<LazyPixelHashes> hashes;
+		
+		/// How the image is painted on the layers below it
+		Blending::Mode mode{ Blending::Mode::ALPHA_REPLACE };
+		
+		/// Set by canvas(), blend() only paints in place on canvases
+		bool is_canvas{ false };
+		
+		/// Evicts and recreates images, keeping the mask and hashes
+		friend class ImageStore;
+		
 	public:
 		/** \param [in] pos Offset of the image
 		 *  \param [in] img The image data */
@@ -44,8 +64,10 @@ class Image {
 		Image( QString path ) : Image( QImage(path) ) { }
 		
 	private:
-		Image( SubQImage img, QImage mask ) : img(img), mask(mask) { }
-		Image newMask( QImage mask ) const{ return Image( img, mask ); }
+		Image( SubQImage img, PixelMask mask, std::shared_ptr<LazyPixelHashes> hashes=nullptr )
+			: img(img), mask(mask), hashes(hashes) { }
+		Image newMask( PixelMask mask ) const{ return Image( img, mask, hashes ).with_mode( mode ); }
+		RowMatcher row_matcher( const Image& other ) const;
 		/*
 		QList<Image> segment() const;
 		QList<Image> diff_segment( Image diff ) const;*/
@@ -63,9 +85,41 @@ class Image {
 		/** \return The offset of the image */
 		QPoint get_pos() const{ return img.offset(); }
 		
+		/** \return How the image is painted on the layers below it */
+		Blending::Mode blend_mode() const{ return mode; }
+		
+		/** \return true if the image replaces the pixels it shows, which all
+		 *  the operations sharing pixels between images rely on */
+		bool replaces_pixels() const{ return mode == Blending::Mode::ALPHA_REPLACE; }
+		
+		/** \param [in] new_mode How the image should be painted
+		 *  \return A copy using **new_mode** */
+		Image with_mode( Blending::Mode new_mode ) const{
+			auto copy = *this;
+			copy.mode = new_mode;
+			return copy;
+		}
+		
+		/** \return The area covered by the image */
+		QRect get_rect() const{ return { get_pos(), img.size() }; }
+		
 		/** \return The image data */
 		QImage qimg() const{ return img.get(); }
 		
+		/** \return This image with its own copy of only the pixels it covers,
+		 *  so the QImage it was cropped from can be freed */
+		Image compacted() const{
+			auto copy = *this;
+			copy.img = img.compact();
+			return copy;
+		}
+		
+		/** \return The pixels of row **iy**, without considering the mask */
+		const QRgb* row( int iy ) const{ return img.row( iy ); }
+		
+		/** \return Hashes of the image data, or nullptr if not available */
+		const PixelHashes* pixel_hashes() const{ return hashes ? &hashes->get( img ) : nullptr; }
+		
 		/** Save the image to the file system
 		 *  \param [in] path The location on the file system
 		 *  \param [in] format The format used for compression
@@ -89,14 +143,22 @@ class Image {
 		Image sub_image( int x, int y, int width, int height ) const{
 			QSize newSize( std::min( x+width,  x+mask.width()  ) - x
 			             , std::min( y+height, y+mask.height() ) - y );
-			auto newMask = newSize.isNull() ? QImage() : mask.copy( x,y, newSize.width(), newSize.height() );
-			return Image( img.copy( {x,y}, newSize ), newMask );
+			auto newMask = newSize.isNull() ? PixelMask() : mask.copy( x,y, newSize.width(), newSize.height() );
+			return Image( img.copy( {x,y}, newSize ), newMask ).with_mode( mode );
 		}
 		
+		static Image canvas( QRect area );
+		void blend( const Image& on_top );
 		Image combine( Image on_top ) const;
+		BitMask painted() const;
+		bool is_redundant( const Image& canvas, const BitMask& hidden ) const;
 		
 		Image contain_both( Image diff ) const;
 		struct SplitImage split_shared( Image other ) const;
+		struct OffsetImage offset_difference( Image other, int max_diff ) const;
+		BitMask shared_pixels( const Image& other ) const;
+		Image only_pixels( const BitMask& area ) const;
+		Image without_pixels( const BitMask& area ) const;
 		
 		/** Calculates file size of the image; wrapper for Format::file_size()
 		 *  \param [in] format Format used for compression
@@ -109,8 +171,11 @@ class Image {
 			return saved_data.size();
 		}
 		int alpha_count() const;
+		std::vector<int> shown_per_tile( int size ) const;
 		
 		Image difference( Image img ) const;
+		QRect difference_bounds( Image img ) const;
+		Image difference_cropped( Image img ) const;
 		Image remove_area( Image img ) const;
 		Image clean_alpha( int kernel_size, int threshold ) const;
 		QImage remove_transparent() const;
@@ -129,6 +194,12 @@ class Image {
 };
 
 
+struct OffsetImage{
+	Image offset;  ///< add-offset layer for the pixels which only change a little
+	Image overlay; ///< alpha-replace layer for the remaining changed pixels
+	OffsetImage() : offset( {0,0}, {} ), overlay(offset) {}
+};
+
 struct SplitImage{
 	Image shared;
 	Image first;
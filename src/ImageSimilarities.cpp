@@ -18,24 +18,18 @@
 #include "ImageSimilarities.hpp"
 #include "Image.hpp"
 
+#include <algorithm>
 #include <cassert>
 
 const int MASK_TRUE  = 1;
 const int MASK_FALSE = 0;
 
 ImageMask::ImageMask( int width, int height )
-	: mask( width, height, QImage::Format_Indexed8 ) { }
+	: mask( width, height ) { }
 	
 void ImageMask::combineMasks( ImageMask combine_with ){
 	assert( size() == combine_with.size() );
-	
-	for( int iy=0; iy<height(); iy++ ){
-		auto row   = scanLine( iy );
-		auto input = combine_with.constScanLine( iy );
-		
-		for( int ix=0; ix<width(); ix++ )
-			row[ix] = (row[ix] || input[ix]) ? MASK_TRUE : MASK_FALSE;
-	}
+	mask.combine( combine_with.mask );
 }
 
 RefImage::RefImage( int width, int height )
@@ -53,10 +47,10 @@ void RefImage::setMaskTo( ImageMask mask, uint16_t value ){
 	
 	for( int iy=0; iy<height; iy++ ){
 		auto row = getRow( iy );
-		auto m_row = mask.constScanLine( iy );
+		auto m_row = mask.constRow( iy );
 		
 		for( int ix=0; ix<width; ix++ )
-			row[ix] = (m_row[ix] == MASK_TRUE) ? value : row[ix];
+			row[ix] = (BitMask::get( m_row, ix ) == MASK_TRUE) ? value : row[ix];
 	}
 }
 void RefImage::fill( uint16_t value ){
@@ -70,9 +64,14 @@ ImageMask RefImage::getMaskOf( uint16_t value ){
 	
 	for( int iy=0; iy<height; iy++ ){
 		auto row = getRow( iy );
-		auto out = mask.scanLine( iy );
-		for( int ix=0; ix<width; ix++ )
-			out[ix] = (row[ix] == value) ? MASK_TRUE : MASK_FALSE;
+		auto out = mask.row( iy );
+		for( int i=0; i<mask.words(); i++ ){
+			BitMask::Word word = 0;
+			auto start = i * BitMask::PER_WORD, end = std::min( start + BitMask::PER_WORD, width );
+			for( int ix=start; ix<end; ix++ )
+				word |= BitMask::Word( row[ix] == value ) << (ix - start);
+			out[i] = word;
+		}
 	}
 	
 	//TODO: Return null mask if all false
@@ -90,14 +89,17 @@ static ImageMask createMask( QImage img1, QImage img2, ImageMask& mask ){
 	for( int iy=0; iy<img1.height(); iy++ ){
 		auto row1 = (const QRgb*)img1.constScanLine( iy );
 		auto row2 = (const QRgb*)img2.constScanLine( iy );
-		auto row_old = mask.scanLine( iy );
-		auto row_new = new_mask.scanLine( iy );
+		auto row_old = mask.row( iy );
+		auto row_new = new_mask.row( iy );
 		
-		for( int ix=0; ix<img1.width(); ix++ ){
-			if( (row_old[ix] == MASK_FALSE) && (row1[ix] == row2[ix]) ){
-				row_new[ix] = MASK_TRUE;
-				row_old[ix] = MASK_TRUE;
-			}
+		for( int i=0; i<mask.words(); i++ ){
+			BitMask::Word equal = 0;
+			auto start = i * BitMask::PER_WORD, end = std::min( start + BitMask::PER_WORD, img1.width() );
+			for( int ix=start; ix<end; ix++ )
+				equal |= BitMask::Word( row1[ix] == row2[ix] ) << (ix - start);
+			
+			row_new[i] = equal & ~row_old[i];
+			row_old[i] |= equal;
 		}
 	}
 	
@@ -113,9 +115,9 @@ Image ImageMask::apply( QImage image ) const{
 	
 	for( int iy=0; iy<image.height(); iy++ ){
 		auto row = (QRgb*)image.scanLine( iy );
-		auto in  = constScanLine( iy );
+		auto in  = constRow( iy );
 		for( int ix=0; ix<image.width(); ix++ )
-			if( in[ix] == MASK_FALSE )
+			if( BitMask::get( in, ix ) == MASK_FALSE )
 				row[ix] = makeTransparent( row[ix] );
 	}
 	
@@ -20,6 +20,9 @@
 
 #include <QImage>
 #include <QList>
+
+#include "PackedMask.hpp"
+
 #include <memory>
 #include <vector>
 
@@ -27,7 +30,7 @@ class Image;
 
 class ImageMask{
 	private:
-		QImage mask;
+		BitMask mask;
 		
 	public:
 		ImageMask( int width, int height );
@@ -36,8 +39,10 @@ class ImageMask{
 		auto width() const { return mask.width(); }
 		auto height() const { return mask.height(); }
 		auto size() const { return mask.size(); }
-		auto scanLine( int iy ){ return mask.scanLine( iy ); }
-		auto constScanLine( int iy ) const { return mask.constScanLine( iy ); }
+		auto row( int iy ){ return mask.row( iy ); }
+		auto constRow( int iy ) const { return mask.constRow( iy ); }
+		auto words() const { return mask.words(); }
+		bool get( int ix, int iy ) const { return mask.get( ix, iy ); }
 		void fill( unsigned value ){ mask.fill( value ); }
 		
 		void combineMasks( ImageMask combine_with );
@@ -0,0 +1,213 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ImageStore.hpp"
+#include "Compression.hpp"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTemporaryFile>
+
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+#include <vector>
+
+struct ImageStore::Entry{
+	Image image{ {0,0}, QImage() }; ///< Invalid while evicted
+	
+	//Everything needed to recreate **image** after it has been evicted
+	QRect rect;
+	PixelMask mask;
+	std::shared_ptr<LazyPixelHashes> hashes;
+	Blending::Mode mode;
+	QByteArray saved_data;
+	
+	qint64 offset{ -1 }; ///< Position in the spill file, -1 if not written yet
+	int packed_size{ 0 };
+	quint64 last_used{ 0 };
+	
+	bool decoded() const{ return image.is_valid(); }
+	bool empty() const{ return rect.isEmpty(); } ///< Invalid images are never evicted
+	qint64 bytes() const{ return qint64(rect.width()) * rect.height() * sizeof(QRgb); }
+};
+
+struct ImageStore::Cache{
+	QMutex mutex;
+	qint64 budget;
+	qint64 used{ 0 };
+	quint64 clock{ 0 };
+	
+	/// The entries which currently are decoded
+	std::vector<std::shared_ptr<Entry>> resident;
+	
+	/// lz4 compressed pixels of evicted images, written once per image
+	QTemporaryFile spill;
+	bool spill_failed{ false };
+	
+	Cache( qint64 budget ) : budget(budget) { }
+	
+	bool limited() const{ return budget > 0; }
+	
+	/** Compress the pixels of **entry** to the spill file, if not done already
+	 *  \return true if the pixels can be read back with read() */
+	bool write( Entry& entry ){
+		if( entry.offset >= 0 )
+			return true;
+		if( !spill.isOpen() && !spill.open() )
+			return false;
+		
+		auto pixels = entry.image.qimg();
+		auto packed = FileSize::lz4compress( pixels.constBits(), entry.bytes() );
+		if( packed.empty() )
+			return false;
+		
+		auto offset = spill.size();
+		if( !spill.seek( offset ) || spill.write( (const char*)packed.data(), packed.size() ) != qint64(packed.size()) )
+			return false;
+		
+		entry.offset = offset;
+		entry.packed_size = packed.size();
+		return true;
+	}
+	
+	/** \return The compressed pixels written by write() */
+	QByteArray read( const Entry& entry ){
+		if( !spill.seek( entry.offset ) )
+			return {};
+		return spill.read( entry.packed_size );
+	}
+	
+	/** Add a newly decoded entry and evict the least recently used entries
+	 *  until the budget is met again. **entry** itself is never evicted. */
+	void insert( std::shared_ptr<Entry> entry ){
+		entry->last_used = ++clock;
+		used += entry->bytes();
+		resident.push_back( entry );
+		
+		while( used > budget && !spill_failed ){
+			auto oldest = resident.end();
+			for( auto it=resident.begin(); it!=resident.end(); ++it )
+				if( *it != entry && (oldest == resident.end() || (*it)->last_used < (*oldest)->last_used) )
+					oldest = it;
+			if( oldest == resident.end() )
+				return;
+			
+			if( !write( **oldest ) ){
+				qWarning( "Could not write to the image cache, keeping all images in memory" );
+				spill_failed = true;
+				return;
+			}
+			
+			used -= (*oldest)->bytes();
+			(*oldest)->image = Image( {0,0}, QImage() );
+			resident.erase( oldest );
+		}
+	}
+	
+	/** Stop tracking **entry**, which is no longer in any store */
+	void remove( const std::shared_ptr<Entry>& entry ){
+		auto it = std::find( resident.begin(), resident.end(), entry );
+		if( it != resident.end() ){
+			used -= entry->bytes();
+			resident.erase( it );
+		}
+	}
+};
+
+
+ImageStore::ImageStore( qint64 budget ) : cache( std::make_shared<Cache>( budget ) ) { }
+
+qint64 ImageStore::budget() const{ return cache->budget; }
+
+ImageStore ImageStore::sharing_budget() const{
+	ImageStore store;
+	store.cache = cache;
+	return store;
+}
+
+int ImageStore::fitting() const{
+	if( !cache->limited() || isEmpty() )
+		return INT_MAX;
+	auto amount = cache->budget / std::max( entries.first()->bytes(), qint64(1) );
+	return std::max( 2, int( std::min( amount, qint64(INT_MAX) ) ) );
+}
+
+/** \return An entry for **image**. With a budget it only keeps the pixels
+ *  it covers, as a cropped image would keep the full QImage in memory. */
+std::shared_ptr<ImageStore::Entry> ImageStore::make_entry( const Image& image ) const{
+	auto entry = std::make_shared<Entry>();
+	entry->image  = cache->limited() ? image.compacted() : image;
+	entry->rect   = image.is_valid() ? image.get_rect() : QRect();
+	entry->mask   = image.mask;
+	entry->hashes = image.hashes ? image.hashes : std::make_shared<LazyPixelHashes>();
+	entry->mode   = image.mode;
+	entry->saved_data = image.saved_data;
+	return entry;
+}
+
+void ImageStore::append( const Image& image ){
+	auto entry = make_entry( image );
+	entries.append( entry );
+	
+	if( cache->limited() && !entry->empty() ){
+		QMutexLocker locker( &cache->mutex );
+		cache->insert( entry );
+	}
+}
+
+void ImageStore::set( int index, const Image& image ){
+	auto entry = make_entry( image );
+	if( !cache->limited() ){
+		entries[index] = entry;
+		return;
+	}
+	
+	QMutexLocker locker( &cache->mutex );
+	cache->remove( entries[index] );
+	entries[index] = entry;
+	if( !entry->empty() )
+		cache->insert( entry );
+}
+
+Image ImageStore::operator[]( int index ) const{
+	auto entry = entries[index];
+	if( !cache->limited() || entry->empty() )
+		return entry->image;
+	
+	QByteArray packed;
+	{	QMutexLocker locker( &cache->mutex );
+		if( entry->decoded() ){
+			entry->last_used = ++cache->clock;
+			return entry->image;
+		}
+		packed = cache->read( *entry );
+	}
+	
+	//Decompress without blocking the other threads
+	QImage pixels( entry->rect.size(), QImage::Format_ARGB32 );
+	if( !FileSize::lz4decompress( (const unsigned char*)packed.constData(), packed.size(), pixels.bits(), entry->bytes() ) )
+		throw std::runtime_error( "ImageStore could not read back an evicted image" );
+	
+	QMutexLocker locker( &cache->mutex );
+	if( !entry->decoded() ){ //Another thread might have loaded it already
+		entry->image = Image( SubQImage( pixels, entry->rect.topLeft() ), entry->mask, entry->hashes ).with_mode( entry->mode );
+		entry->image.saved_data = entry->saved_data;
+		cache->insert( entry );
+	}
+	return entry->image;
+}
@@ -0,0 +1,79 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGE_STORE_HPP
+#define IMAGE_STORE_HPP
+
+#include "Image.hpp"
+
+#include <QList>
+
+#include <memory>
+
+/** A list of images, which keeps as many of them decoded as a
+ *  memory budget allows. The least recently used images are compressed to a
+ *  temporary file when the budget is exceeded, and decoded again on demand.
+ *  
+ *  The budget is not strict, images returned stay in memory until all copies
+ *  of them are gone, and the image being loaded is never evicted.
+ *  Copies of the store share the budget and the images, and it is safe to
+ *  read the images from several threads. */
+class ImageStore{
+	private:
+		struct Entry;
+		struct Cache;
+		QList<std::shared_ptr<Entry>> entries;
+		std::shared_ptr<Cache> cache;
+		
+		std::shared_ptr<Entry> make_entry( const Image& image ) const;
+		
+	public:
+		/** \param [in] budget Bytes of decoded images to keep in memory, 0 for no limit */
+		ImageStore( qint64 budget=0 );
+		
+		/** \return Bytes of decoded images kept in memory, 0 for no limit */
+		qint64 budget() const;
+		
+		/** \return An empty store sharing the budget with this one */
+		ImageStore sharing_budget() const;
+		
+		int size()  const{ return entries.size(); }
+		int count() const{ return entries.size(); }
+		bool isEmpty() const{ return entries.isEmpty(); }
+		
+		/** \return The image at **index**, decoding it if necessary */
+		Image operator[]( int index ) const;
+		Image first() const{ return (*this)[0]; }
+		
+		/** \return The amount of images like first() which fit in the budget, at least 2 */
+		int fitting() const;
+		
+		/** \param [in] image The image to add, may be invalid */
+		void append( const Image& image );
+		
+		/** \param [in] index The image to replace
+		 *  \param [in] image The new image, may be invalid */
+		void set( int index, const Image& image );
+		
+		ImageStore& operator<<( const QList<Image>& images ){
+			for( auto& image : images )
+				append( image );
+			return *this;
+		}
+};
+
+#endif
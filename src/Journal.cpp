@@ -0,0 +1,137 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Journal.hpp"
+#include "FileUtils.hpp"
+
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+/** \return The checksum stored together with **line** */
+QByteArray Journal::checksum( const QByteArray& line ){
+	return QCryptographicHash::hash( line, QCryptographicHash::Sha1 ).toHex();
+}
+
+Journal::Journal( QString path, QString options ) : file( path ), options( options ){
+	if( !file.open( QIODevice::ReadWrite ) )
+		return;
+	
+	//Each line is "<checksum> <json>", as the JSON is compact it has no newlines
+	auto contents = file.readAll();
+	auto end = contents.lastIndexOf( '\n' ) + 1;
+	if( end < contents.size() ){
+		//Drop a partially written line, so the next record starts on its own line
+		if( !file.resize( end ) || !sync_file( file ) )
+			return;
+		contents.truncate( end );
+	}
+	
+	for( auto line : contents.split( '\n' ) ){
+		auto space = line.indexOf( ' ' );
+		if( space < 0 )
+			continue;
+		auto json = line.mid( space + 1 );
+		if( line.left( space ) != checksum( json ) ){
+			qWarning( "Ignoring damaged line in journal '%s'", path.toLocal8Bit().constData() );
+			continue;
+		}
+		
+		auto object = QJsonDocument::fromJson( json ).object();
+		Entry entry;
+		for( auto input : object["inputs"].toArray() )
+			entry.inputs << input.toString().toLatin1();
+		entry.options     = object["options"].toString();
+		entry.output      = object["output"].toString();
+		entry.size        = object["size"].toDouble();
+		entry.output_hash = object["output_hash"].toString().toLatin1();
+		if( !entry.inputs.isEmpty() )
+			entries[entry.inputs.first()] << entry;
+	}
+	
+	valid = file.seek( file.size() );
+}
+
+int Journal::completed( const QStringList& files, int start, QString output ) const{
+	auto first = hash_file( files[start] );
+	if( first.isEmpty() || !entries.contains( first ) )
+		return 0;
+	
+	//Only the latest record of each set counts, as the output is overwritten
+	auto output_path = QFileInfo( output ).absoluteFilePath();
+	auto sets = entries.value( first );
+	for( int k=sets.size()-1; k>=0; k-- ){
+		auto& entry = sets[k];
+		if( entry.options != options || entry.output != output_path )
+			continue;
+		if( start + entry.inputs.size() > files.size() )
+			return 0;
+		for( int i=1; i<entry.inputs.size(); i++ )
+			if( hash_file( files[start+i] ) != entry.inputs[i] )
+				return 0;
+		
+		//The output must still be the file which was validated
+		if( QFileInfo( entry.output ).size() != entry.size || hash_file( entry.output ) != entry.output_hash )
+			return 0;
+		
+		return entry.inputs.size();
+	}
+	
+	return 0;
+}
+
+bool Journal::record( const QStringList& inputs, QString output ){
+	if( !valid || inputs.isEmpty() )
+		return false;
+	
+	//The output must be on the disk before the journal claims it is done
+	if( !sync_file( output ) )
+		return false;
+	
+	Entry entry;
+	QJsonArray input_hashes;
+	for( auto input : inputs ){
+		entry.inputs << hash_file( input );
+		input_hashes.append( QString::fromLatin1( entry.inputs.last() ) );
+	}
+	entry.options = options;
+	entry.output = QFileInfo( output ).absoluteFilePath();
+	entry.size = QFileInfo( output ).size();
+	entry.output_hash = hash_file( output );
+	
+	QJsonObject object;
+	object["inputs"] = input_hashes;
+	object["options"] = entry.options;
+	object["output"] = entry.output;
+	object["size"] = double( entry.size );
+	object["output_hash"] = QString::fromLatin1( entry.output_hash );
+	
+	auto json = QJsonDocument( object ).toJson( QJsonDocument::Compact );
+	auto line = checksum( json ) + " " + json + "\n";
+	auto journal_end = file.size();
+	if( file.write( line ) != line.size() || !sync_file( file ) ){
+		//Do not leave a partial line which the next record would be appended to
+		file.resize( journal_end );
+		file.seek( journal_end );
+		return false;
+	}
+	
+	entries[entry.inputs.first()] << entry;
+	return true;
+}
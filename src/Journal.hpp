@@ -0,0 +1,76 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+/** Records the image sets which have been compressed and validated, so an
+ *  interrupted batch run can continue where it stopped.
+ *  
+ *  Each set is a line of JSON appended to the journal file and synced to the
+ *  disk before continuing. Every line contains a checksum, so a line cut off by
+ *  a crash is ignored instead of being trusted. A set is only done if all
+ *  its inputs, the options and the output path match the recorded ones. */
+class Journal{
+	private:
+		struct Entry{
+			QList<QByteArray> inputs; ///< SHA-1 of the input files
+			QString options;
+			QString output;
+			qint64 size;
+			QByteArray output_hash;
+		};
+		
+		QFile file;
+		QString options;
+		/// Completed sets by the hash of their first input, the latest last
+		QHash<QByteArray, QList<Entry>> entries;
+		bool valid{ false };
+		
+		static QByteArray checksum( const QByteArray& line );
+		
+	public:
+		/** Open the journal at **path**, creating it if it does not exist
+		 *  \param [in] path The journal file
+		 *  \param [in] options Describes the options which affect the output */
+		Journal( QString path, QString options );
+		
+		/** \return true if the journal could be opened */
+		bool is_open() const{ return valid; }
+		
+		/** Check if a set starting at **start** already has been compressed
+		 *  \param [in] files All input files
+		 *  \param [in] start The first file of the set
+		 *  \param [in] output The file the set would be compressed to
+		 *  \return The amount of files in the set, or 0 if it needs to be compressed */
+		int completed( const QStringList& files, int start, QString output ) const;
+		
+		/** Record a set as done, call it only after the output has been validated
+		 *  \param [in] inputs The files in the set
+		 *  \param [in] output The compressed file
+		 *  \return true if the record has reached the disk */
+		bool record( const QStringList& inputs, QString output );
+};
+
+#endif
@@ -18,19 +18,28 @@
 #include "MultiImage.hpp"
 #include "OraSaver.hpp"
 #include "Converter.hpp"
+#include "FrameCache.hpp"
 #include "ProgressBar.hpp"
+#include "RunReport.hpp"
+#include "StageTimer.hpp"
+#include "Trace.hpp"
 
 #include "ImageSimilarities.hpp"
+#include "VirtualAncestors.hpp"
 
 #include <algorithm>
 #include <climits>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <string>
+#include <vector>
 
+#include <QFileInfo>
 #include <QImageReader>
+#include <QJsonArray>
 #include <QtConcurrent>
 #include <QDebug>
-#include <QElapsedTimer>
 
 
 /** Find a converter to a frame not found
@@ -60,29 +69,76 @@ void add_converter( QList<Converter>& used_converters, const QList<Converter>& c
 	used_converters << *best_converter;
 }
 
+/** \return true if all the originals can be reached with **used_converters**
+ *  \param [in] used_converters The converters found so far
+ *  \param [in] originals The amount of originals, which are the first nodes */
+static bool covers_originals( const QList<Converter>& used_converters, int originals ){
+	int found = 0;
+	for( auto& converter : used_converters )
+		if( converter.get_to() < originals )
+			found++;
+	return found >= originals;
+}
+
+/** Remove converters to virtual ancestors which no frame is created from
+ *  \param [in,out] used_converters The converters found
+ *  \param [in] originals The amount of originals, which are the first nodes */
+static void remove_unused_ancestors( QList<Converter>& used_converters, int originals ){
+	auto is_unused = [&]( const Converter& converter ){
+			if( converter.get_to() < originals )
+				return false;
+			for( auto& other : used_converters )
+				if( other.get_from() == converter.get_to() && other.get_to() != converter.get_to() )
+					return false;
+			return true;
+		};
+	
+	//Removing one can cause its parent to become unused as well
+	for( int i=0; i<used_converters.size(); )
+		if( is_unused( used_converters[i] ) ){
+			used_converters.removeAt( i );
+			i = 0;
+		}
+		else
+			i++;
+}
+
 struct ConverterPara{
 	const MultiImage* parent;
+	const ImageStore* images;
 	int i, j;
-	ConverterPara( const MultiImage* parent, int i, int j ) : parent(parent), i(i), j(j) { }
+	ConverterPara( const MultiImage* parent, int i, int j ) : ConverterPara( parent, &parent->originals, i, j ) { }
+	ConverterPara( const MultiImage* parent, const ImageStore* images, int i, int j )
+		: parent(parent), images(images), i(i), j(j) { }
 };
 Converter createConverter( const ConverterPara& p ){
-	return Converter( p.parent->originals, p.i, p.j, p.parent->format );
+	Trace::Span span( "converter" );
+	return Converter( *p.images, p.i, p.j, p.parent->format );
+}
+
+/** \return true if pixels of **primitive** may be shared with other primitives,
+ *  which is only possible for used primitives replacing the pixels below */
+static bool can_share( const Image& primitive ){
+	return primitive.is_valid() && primitive.replaces_pixels();
 }
 
-static void reuse_planes( QList<Image>& primitives, QList<Frame>& frames ){
+/** Combine primitives which can be replaced by a single primitive
+ *  \return The amount of primitives removed */
+static int reuse_planes( ImageStore& primitives, QList<Frame>& frames ){
+	int combined = 0;
 	// Try to reuse planes if possible
 	for( int i=0; i<primitives.size(); i++ ){
-		if( !primitives[i].is_valid() )
+		if( !can_share( primitives[i] ) )
 			continue;
 		for( int j=i+1; j<primitives.size(); j++ ){
-			if( !primitives[j].is_valid() )
+			if( !can_share( primitives[j] ) )
 				continue;
 			
 			Image result = primitives[i].contain_both( primitives[j] );
 			if( result.is_valid() ){
-				primitives[i] = result;
-				primitives[j] = Image( {0,0}, QImage() );
-				qDebug( "   Combining difference %d and %d", i, j );
+				primitives.set( i, result );
+				primitives.set( j, Image( {0,0}, QImage() ) );
+				combined++;
 				
 				for( auto& frame : frames )
 					for( auto& layer : frame.layers )
@@ -91,45 +147,294 @@ static void reuse_planes( QList<Image>& primitives, QList<Frame>& frames ){
 			}
 		}
 	}
+	
+	return combined;
 }
 
-static void reuse_planes2( QList<Image>& primitives, QList<Frame>& frames, Format format ){
-	reuse_planes( primitives, frames );
+/** Finds the areas which overlap a given area. The areas are sorted by their
+ *  left edge, so only those starting less than the widest area to the left
+ *  of the query needs to be checked. */
+class OverlapIndex{
+	private:
+		std::multimap<int,int> by_left;
+		std::vector<QRect> areas;
+		int max_width{ 0 };
+		
+	public:
+		/** \param [in] index Id of the area, must not already be in use
+		 *  \param [in] area The area, ignored if empty */
+		void add( int index, QRect area ){
+			areas.resize( std::max( int(areas.size()), index+1 ) );
+			areas[index] = area;
+			if( area.isEmpty() )
+				return;
+			
+			by_left.insert( { area.left(), index } );
+			max_width = std::max( max_width, area.width() );
+		}
+		
+		void remove( int index ){
+			auto range = by_left.equal_range( areas[index].left() );
+			for( auto it = range.first; it != range.second; ++it )
+				if( it->second == index ){
+					by_left.erase( it );
+					break;
+				}
+			areas[index] = QRect();
+		}
+		
+		/** \return The ids of all areas overlapping **area**, in increasing order */
+		std::vector<int> overlapping( QRect area ) const{
+			std::vector<int> found;
+			if( area.isEmpty() )
+				return found;
+			
+			auto end = by_left.upper_bound( area.right() );
+			for( auto it = by_left.lower_bound( area.left() - max_width ); it != end; ++it )
+				if( areas[it->second].intersects( area ) )
+					found.push_back( it->second );
+			
+			std::sort( found.begin(), found.end() );
+			return found;
+		}
+};
+
+/** \return An upper bound of the amount of pixels shown in both images
+ *  \param [in] img1 The first image
+ *  \param [in] tiles1 Result of Image::shown_per_tile() for **img1**
+ *  \param [in] img2 The second image
+ *  \param [in] tiles2 Result of Image::shown_per_tile() for **img2** */
+static int shared_upper_bound( const Image& img1, const std::vector<int>& tiles1, const Image& img2, const std::vector<int>& tiles2 ){
+	if( img1.get_rect() != img2.get_rect() )
+		return INT_MAX; //Tiles do not line up
+	
+	int bound = 0;
+	for( unsigned i=0; i<tiles1.size(); i++ )
+		bound += std::min( tiles1[i], tiles2[i] );
+	return bound;
+}
+
+/** Most candidates considered for a group in extract_common_planes(),
+ *  the ones sharing the most pixels are kept */
+const int MAX_COMMON_CANDIDATES = 16;
+
+/** Extract areas shown with the same pixels in three or more primitives.
+ *  Splitting those pairwise would store a fragment of the area for each pair,
+ *  so instead groups are grown greedily by intersecting their shared pixels,
+ *  and the common area is stored once.
+ *  Like reuse_planes2(), only primitives which overlap and show pixels in the
+ *  same tiles are compared, and the amount of candidates is capped.
+ *  \param [in,out] primitives The primitives to extract from, all with the same size
+ *  \param [in,out] frames Frames which are updated to the new primitives
+ *  \param [in] format The format used for evaluating file sizes
+ *  \return The amount of bytes saved */
+static int extract_common_planes( ImageStore& primitives, QList<Frame>& frames, Format format ){
+	std::function<int( const Image& )> size_exact = [&]( const Image& img ){
+			Trace::Span span( "size_exact" );
+			return img.auto_crop().compressed_size( format, Format::HIGH );
+		};
+	auto total_size = [&]( const QList<Image>& images ){
+			int sum = 0;
+			for( auto size : QtConcurrent::mapped( images, size_exact ).results() )
+				sum += size;
+			return sum;
+		};
+	
+	//Index where the primitives have content, as only overlapping pixels can be shared
+	OverlapIndex overlaps;
+	std::vector<std::vector<int>> tiles;
+	auto add_primitive = [&]( int index ){
+		auto primitive = primitives[index];
+		overlaps.add( index, can_share( primitive ) ? primitive.auto_crop().get_rect() : QRect() );
+		tiles.push_back( primitive.shown_per_tile( PixelHashes::TILE_SIZE ) );
+	};
+	for( int i=0; i<primitives.size(); i++ )
+		add_primitive( i );
 	
 	int amount_saved = 0;
+	for( int i=0; i<primitives.size(); i++ ){
+		if( !can_share( primitives[i] ) )
+			continue;
+		
+		QList<int> candidates;
+		for( auto j : overlaps.overlapping( primitives[i].auto_crop().get_rect() ) )
+			if( j > i && can_share( primitives[j] ) && primitives[j].get_rect() == primitives[i].get_rect()
+				&&	shared_upper_bound( primitives[i], tiles[i], primitives[j], tiles[j] ) > 0 )
+				candidates << j;
+		if( candidates.size() < 2 )
+			continue;
+		
+		//Find the pixels each later primitive could share with this one
+		std::function<BitMask( int )> shared_with = [&]( int j ){
+				Trace::Span span( "shared_pixels" );
+				return primitives[i].shared_pixels( primitives[j] );
+			};
+		auto shared = QtConcurrent::mapped( candidates, shared_with ).results();
+		
+		//Only keep the candidates sharing the most pixels, in their original order
+		if( candidates.size() > MAX_COMMON_CANDIDATES ){
+			std::vector<int> order( candidates.size() );
+			for( unsigned k=0; k<order.size(); k++ )
+				order[k] = k;
+			std::stable_sort( order.begin(), order.end()
+				,	[&]( int a, int b ){ return shared[a].count( 1 ) > shared[b].count( 1 ); } );
+			order.resize( MAX_COMMON_CANDIDATES );
+			std::sort( order.begin(), order.end() );
+			
+			QList<int> kept_candidates;
+			QList<BitMask> kept_shared;
+			for( auto k : order ){
+				kept_candidates << candidates[k];
+				kept_shared << shared[k];
+			}
+			candidates = kept_candidates;
+			shared = kept_shared;
+		}
+		
+		//Add primitives as long as it increases the amount of pixels stored only once.
+		//With n primitives in the group, (n-1) copies of the common area are saved.
+		QList<int> group{ i };
+		BitMask common;
+		int pixels_saved = 0;
+		std::vector<bool> added( candidates.size(), false );
+		while( true ){
+			int best = -1;
+			BitMask best_common;
+			for( int k=0; k<candidates.size(); k++ ){
+				//The intersection can't share more pixels than the candidate does
+				if( added[k] || group.size() * shared[k].count( 1 ) <= pixels_saved )
+					continue;
+				
+				auto next = shared[k];
+				if( !common.isNull() )
+					next.intersect( common );
+				
+				int saved = group.size() * next.count( 1 );
+				if( saved > pixels_saved ){
+					best = k;
+					best_common = next;
+					pixels_saved = saved;
+				}
+			}
+			if( best < 0 )
+				break;
+			
+			added[best] = true;
+			group << candidates[best];
+			common = best_common;
+		}
+		
+		//Pairs are left for split_shared()
+		if( group.size() < 3 )
+			continue;
+		
+		//Do an exact evaluation of saved filesize
+		auto shared_plane = primitives[i].only_pixels( common );
+		QList<Image> old_planes, new_planes{ shared_plane }, remaining;
+		for( auto index : group ){
+			auto rest = primitives[index].without_pixels( common );
+			old_planes << primitives[index];
+			remaining << rest;
+			if( rest.alpha_count() > 0 )
+				new_planes << rest;
+		}
+		auto size_saved = total_size( old_planes ) - total_size( new_planes );
+		
+		//Update if we save at least 128 bytes, like reuse_planes2()
+		if( size_saved <= 128 )
+			continue;
+		amount_saved += size_saved;
+		
+		//Change the primitives and update the frames
+		int shared_pos = primitives.size();
+		primitives.append( shared_plane );
+		for( int k=0; k<group.size(); k++ ){
+			QList<int> replacement{ shared_pos };
+			if( remaining[k].alpha_count() > 0 ){
+				replacement.prepend( primitives.size() );
+				primitives.append( remaining[k] );
+			}
+			
+			primitives.set( group[k], Image( {}, {} ) );
+			overlaps.remove( group[k] );
+			for( auto& frame : frames )
+				frame.update_ids( group[k], replacement );
+		}
+		for( int k=shared_pos; k<primitives.size(); k++ )
+			add_primitive( k );
+	}
+	
+	return amount_saved;
+}
+
+/** Reduce the file size by storing pixels shared between primitives only once
+ *  \param [in,out] primitives The primitives to change
+ *  \param [in,out] frames Frames which are updated to the new primitives
+ *  \param [in] format The format used for evaluating file sizes
+ *  \param [out] report Receives the amount of primitives and bytes saved */
+static void reuse_planes2( ImageStore& primitives, QList<Frame>& frames, Format format, RunReport& report ){
+	report.set( "combined_planes", reuse_planes( primitives, frames ) );
+	report.set( "common_bytes_saved", extract_common_planes( primitives, frames, format ) );
+	
+	int amount_saved = 0;
+	
+	//Index where the primitives have content, as only overlapping pixels can be shared
+	OverlapIndex overlaps;
+	std::vector<std::vector<int>> tiles;
+	auto add_primitive = [&]( int index ){
+		auto primitive = primitives[index];
+		overlaps.add( index, can_share( primitive ) ? primitive.auto_crop().get_rect() : QRect() );
+		tiles.push_back( primitive.shown_per_tile( PixelHashes::TILE_SIZE ) );
+	};
+	for( int i=0; i<primitives.size(); i++ )
+		add_primitive( i );
 	
 	for( int i=0; i<primitives.size(); i++ ){
-		if( !primitives[i].is_valid() )
+		if( !can_share( primitives[i] ) )
 			continue;
 		
 		//Try all possible combinations with later primitives, but only save those which can be shared
-		QList<SplitImage> splits;
-		for( int j=i+1; j<primitives.size(); j++ ){
-			if( !primitives[j].is_valid() )
+		QList<int> candidates;
+		for( auto j : overlaps.overlapping( primitives[i].auto_crop().get_rect() ) ){
+			if( j <= i || !can_share( primitives[j] ) )
 				continue;
 			
-			auto split = primitives[i].split_shared( primitives[j] );
-			split.index = j;
-			if( split.shared.auto_crop().is_valid() )
-				splits << split;
+			//Skip the full comparison if the shown pixels are never in the same tiles
+			if( shared_upper_bound( primitives[i], tiles[i], primitives[j], tiles[j] ) == 0 )
+				continue;
+			
+			candidates << j;
 		}
 		
+		//Split in parallel, the results stay in the order of the candidates
+		std::function<SplitImage( int )> split_with = [&]( int j ){
+			Trace::Span span( "split_shared" );
+			auto split = primitives[i].split_shared( primitives[j] );
+			split.index = split.shared.auto_crop().is_valid() ? j : -1;
+			return split;
+		};
+		QList<SplitImage> splits;
+		if( candidates.size() > 0 )
+			for( auto& split : QtConcurrent::mapped( candidates, split_with ).results() )
+				if( split.index >= 0 )
+					splits << split;
+		
 		
 		if( splits.size() > 0 ){
-			auto size_estim = [&](auto& img){ return img.auto_crop().compressed_size( format, Format::MEDIUM ); };
-			auto size_exact = [&](auto& img){ return img.auto_crop().compressed_size( format, Format::HIGH   ); };
+			auto size_estim = [&](const auto& img){ return img.auto_crop().compressed_size( format, Format::MEDIUM ); };
+			auto size_exact = [&](const auto& img){ return img.auto_crop().compressed_size( format, Format::HIGH   ); };
 			
 			//Calculate estimated file savings
 			auto prim_i_size = size_estim( primitives[i] );
-			for( int k=0; k<splits.size(); k++ ){
-				//TODO: If it is used in multiple frames, our savings would increase
-				auto& split = splits[k];
-				auto new_size = size_estim( split.shared ) + size_estim( split.first ) + size_estim( split.second );
-				auto old_size = prim_i_size + size_estim( primitives[split.index] );
-				split.usefulness = old_size - new_size;
-			}
+			QtConcurrent::blockingMap( splits, [&]( SplitImage& split ){
+					Trace::Span span( "estimate_split" );
+					//TODO: If it is used in multiple frames, our savings would increase
+					auto new_size = size_estim( split.shared ) + size_estim( split.first ) + size_estim( split.second );
+					auto old_size = prim_i_size + size_estim( primitives[split.index] );
+					split.usefulness = old_size - new_size;
+				} );
 			
-			//Pick the best one
+			//Pick the best one, the first in case of ties like the serial version
 			auto best = std::max_element( splits.begin(), splits.end(), [](auto&a,auto&b){ return a.usefulness < b.usefulness; } );
 			if( best != splits.end() ){
 				//Do an exact evaluation of saved filesize
@@ -143,58 +448,93 @@ static void reuse_planes2( QList<Image>& primitives, QList<Frame>& frames, Forma
 					amount_saved += size_saved;
 				
 					//Change the primitives
-					primitives[i          ] = Image( {}, {} );
-					primitives[best->index] = Image( {}, {} );
+					primitives.set( i,           Image( {}, {} ) );
+					primitives.set( best->index, Image( {}, {} ) );
 					auto start_pos = primitives.size();
-					primitives << best->shared;
-					primitives << best->first;
-					primitives << best->second;
+					primitives.append( best->shared );
+					primitives.append( best->first );
+					primitives.append( best->second );
 					if( !best->shared.is_valid() || !best->first.is_valid() || !best->second.is_valid() )
 						qFatal( "Not all splitted images are valid" );
 					//TODO: Handle those cases
 					
+					overlaps.remove( i );
+					overlaps.remove( best->index );
+					for( int k=start_pos; k<primitives.size(); k++ )
+						add_primitive( k );
+					
 					//Update the frames with the new primitives
 					for( auto& frame : frames ){
 						frame.update_ids( i,           {start_pos+1, start_pos+0} );
 						frame.update_ids( best->index, {start_pos+2, start_pos+0} );
-						frame.primitives = primitives;
 					}
-					qDebug( "   Extracting shared parts of difference %d and %d, to {%d,%d} and {%d,%d}, saving %d bytes", i, best->index, start_pos+1, start_pos+0,start_pos+2,start_pos+0, size_saved );
 				}
 			}
 			
 		}
 	}
 	
-	qDebug( "   Extracting saved %d bytes", amount_saved );
+	report.set( "split_bytes_saved", amount_saved );
 }
 
 /** Create an efficient composite version and save it to a cgCompress file.
  *  \param [in] name File path for the output file, without the extension
+ *  \param [out] report Receives details about the chosen layering, if not null
  *  \return true on success
  */
-bool MultiImage::optimize( QString name ) const{
+bool MultiImage::optimize( QString name, RunReport* report ) const{
 	if( originals.count() <= 0 )
 		return true;
 	
-	QList<ConverterPara> converter_para;
-	for( int i=0; i<originals.size(); i++ )
-		for( int j=i+1; j<originals.size(); j++ ){
-			converter_para.push_back( { this, i, j } );
-			converter_para.push_back( { this, j, i } );
+	RunReport unused_report;
+	auto& out = report ? *report : unused_report;
+	out.set( "images", originals.size() );
+	out.set( "width",  originals.first().get_rect().width()  );
+	out.set( "height", originals.first().get_rect().height() );
+	
+	//The originals, followed by images the frames can branch from
+	auto nodes = originals;
+	if( format.get_virtual_ancestors() ){
+		StageTimer timer( "virtual_ancestors" );
+		nodes << find_virtual_ancestors( originals );
+	}
+	out.set( "virtual_ancestors", nodes.size() - originals.size() );
+	
+	//Pair the nodes tile by tile, so only the nodes of two tiles are needed
+	//at a time when the memory is limited. Without a limit it is one tile.
+	int tile = std::max( 1, nodes.fitting() / 2 );
+	QList<QList<ConverterPara>> converter_tiles;
+	for( int start_i=0; start_i<nodes.size(); start_i+=tile )
+		for( int start_j=start_i; start_j<nodes.size(); start_j+=tile ){
+			QList<ConverterPara> converter_para;
+			for( int i=start_i; i<std::min( start_i+tile, nodes.size() ); i++ )
+				for( int j=std::max( i+1, start_j ); j<std::min( start_j+tile, nodes.size() ); j++ ){
+					converter_para.push_back( { this, &nodes, i, j } );
+					converter_para.push_back( { this, &nodes, j, i } );
+				}
+			if( !converter_para.isEmpty() )
+				converter_tiles << converter_para;
 		}
-	QElapsedTimer t;
-	t.start();
-	/*/
+	
+	StageTimer converter_timer( "converters" );
 	QList<Converter> converters;
-	for( int i=0; i<converter_para.count(); i++ )
-		converters << createConverter( converter_para[i] );
-	/*/
-	auto future1 = QtConcurrent::mapped( converter_para, createConverter );
-	ProgressBar::showFuture( "Generating data", future1 );
-	auto converters = future1.results();
-	//*/
-	qDebug() << "Took:" << t.elapsed();
+	if( converter_tiles.size() == 1 ){
+		auto future1 = QtConcurrent::mapped( converter_tiles.first(), createConverter );
+		ProgressBar::showFuture( "Generating data", future1 );
+		converters = future1.results();
+	}
+	else{
+		int amount = 0;
+		for( auto& converter_para : converter_tiles )
+			amount += converter_para.size();
+		
+		ProgressBar progress( "Generating data", amount );
+		for( auto& converter_para : converter_tiles ){
+			converters << QtConcurrent::blockingMapped( converter_para, createConverter );
+			progress.update( converter_para.size() );
+		}
+	}
+	converter_timer.stop();
 	
 /*	for( auto converter : converters ){
 		auto name = QString("converter_to_%1_from_%2_%3")
@@ -205,54 +545,186 @@ bool MultiImage::optimize( QString name ) const{
 		converter.get_primitive().auto_crop().save( name, {"webp"} );
 	}//*/
 	
-	//Try all originals as the base image, and pick the best one
+	//Try all originals as the base image, and pick the best one.
+	//Only the converters are kept, as the primitives of every node don't
+	//fit in memory when it is limited.
 	int best_size = INT_MAX;
-	QList<Image> final_primitives;
+	QList<Converter> final_converters;
 	QList<Frame> final_frames;
+	int final_start = 0;
+	QJsonArray final_tree;
+	int final_depth = 0;
 	
 	//Only do the first one, unless high precision have been selected
 	int test_amount = (format.get_precision() == 0) ? originals.size() : 1;
-	{	ProgressBar progress( "Finding efficient solution", test_amount );
+	{	StageTimer timer( "tree_search" );
+		ProgressBar progress( "Finding efficient solution", test_amount );
 		for( int best_start=0; best_start<test_amount; best_start++, progress.update() ){
 			QList<Converter> used_converters;
-			used_converters << Converter( originals, best_start, best_start, format );
+			used_converters << Converter( nodes, best_start, best_start, format );
 			
-			for( int i=1; i<originals.size(); i++ )
+			while( !covers_originals( used_converters, originals.size() ) )
 				add_converter( used_converters, converters );
-			
-			qSort( used_converters.begin(), used_converters.end(), Converter::less_to );
-			QList<Image> primitives;
-			for( auto used : used_converters )
-				primitives.append( used.get_primitive() );
+			remove_unused_ancestors( used_converters, originals.size() );
 			
 			QList<Frame> frames;
-			for( int i=0; i<originals.size(); i++ )
-				frames << Frame( primitives, Converter::path( used_converters, i, best_start ) );
+			int depth = 0;
+			for( int i=0; i<originals.size(); i++ ){
+				frames << Frame( Converter::path( used_converters, i, best_start ) );
+				depth = std::max( depth, frames.last().layers.size() );
+			}
+			
+			//Add-offset layers are painted just before the primitive they belong to,
+			//and are placed after the primitives of the nodes
+			int offset = nodes.size();
+			for( auto used : used_converters )
+				if( used.uses_offset() ){
+					for( auto& frame : frames )
+						frame.update_ids( used.get_to(), { offset, used.get_to() } );
+					offset++;
+				}
 			
 			//Evaluate file size and overwrite old solution if better
 			int filesize = 0;
 			if( test_amount > 0 ) //Skip this for the simple 1-test case
-				for( auto& primitive : primitives )
-					filesize += primitive.compressed_size( format, Format::MEDIUM );
+				for( auto used : used_converters ){
+					filesize += used.get_primitive().compressed_size( format, Format::MEDIUM );
+					if( used.uses_offset() )
+						filesize += used.get_offset_primitive().compressed_size( format, Format::MEDIUM );
+				}
 			if( filesize < best_size ){
 				best_size = filesize;
-				final_primitives = primitives;
+				final_converters = used_converters;
 				final_frames = frames;
+				final_start = best_start;
+				final_depth = depth;
+				
+				//The node each node is converted from, -1 if not used
+				final_tree = QJsonArray();
+				for( int i=0; i<nodes.size(); i++ ){
+					auto is_to = [=]( const Converter& conv ){ return conv.get_to() == i; };
+					auto used = std::find_if( used_converters.begin(), used_converters.end(), is_to );
+					final_tree.append( used != used_converters.end() ? used->get_from() : -1 );
+				}
 			}
 		}
 	}
 	
-	qDebug( "\nRevaluating differences (%d+)", final_primitives.size() );
-	reuse_planes2( final_primitives, final_frames, format );
+	out.set( "base", final_start );
+	out.set( "tree", final_tree );
+	out.set( "tree_depth", final_depth );
 	
-	auto future2 = QtConcurrent::map( final_primitives, [&]( auto& img ){ img = img.optimize_filesize( format ); } );
-	ProgressBar::showFuture( "Optimizing final images", future2 );
+	//Primitives are indexed by node, unused nodes get an invalid image.
+	//They share the budget of the originals, so both stay within it together.
+	auto final_primitives = originals.sharing_budget();
+	for( int i=0; i<nodes.size(); i++ ){
+		auto is_to = [=]( const Converter& conv ){ return conv.get_to() == i; };
+		auto used = std::find_if( final_converters.begin(), final_converters.end(), is_to );
+		final_primitives.append( used != final_converters.end() ? used->get_primitive() : Image( {}, {} ) );
+	}
+	for( auto used : final_converters )
+		if( used.uses_offset() )
+			final_primitives.append( used.get_offset_primitive() );
 	
-	//TODO: Known not to work on transparent images
-	//for( auto& frame : final_frames )
-	//	frame.remove_pointless_layers();
+	{	StageTimer timer( "reuse_planes2" );
+		reuse_planes2( final_primitives, final_frames, format, out );
+	}
 	
-	OraSaver( final_primitives, final_frames ).save( name + ".cgcompress", format );
+	//Optimize as many primitives at a time as fits in memory. The results are
+	//cropped to what they show, and those are kept for saving the file.
+	//The size estimate the layering was chosen with is kept for the report,
+	//as optimize_filesize() replaces it with the encoded size.
+	QList<Image> saved_primitives;
+	std::vector<double> estimates( final_primitives.size(), 0.0 );
+	{	StageTimer timer( "optimize_filesize" );
+		std::function<Image( int )> optimize_primitive = [&]( int index ){
+				Trace::Span span( "optimize_filesize" );
+				auto primitive = final_primitives[index];
+				if( primitive.is_valid() )
+					estimates[index] = primitive.auto_crop().compressed_size( format, Format::MEDIUM );
+				return primitive.optimize_filesize( format );
+			};
+		
+		int chunk = originals.fitting();
+		ProgressBar progress( "Optimizing final images", final_primitives.size() );
+		for( int start=0; start<final_primitives.size(); start+=chunk ){
+			QList<int> indexes;
+			for( int i=start; i<final_primitives.size() && i-start<chunk; i++ )
+				indexes << i;
+			
+			for( auto& optimized : QtConcurrent::blockingMapped( indexes, optimize_primitive ) )
+				saved_primitives << (originals.budget() > 0 ? optimized.compacted() : optimized);
+			progress.update( indexes.size() );
+		}
+	}
+	
+	{	StageTimer timer( "pointless_layers" );
+		int removed = 0;
+		for( auto& frame : final_frames )
+			removed += frame.remove_pointless_layers( saved_primitives );
+		out.set( "pointless_layers", removed );
+	}
+	
+	//Summarize the result
+	QSet<int> used;
+	int layers = 0;
+	for( auto& frame : final_frames ){
+		layers += frame.layers.size();
+		for( auto layer : frame.layers )
+			used << layer;
+	}
+	out.set( "primitives", used.size() );
+	out.set( "layers", layers );
+	
+	//Encode the used primitives, which the saver reuses. Only their size is
+	//comparable to the estimate, the file also contains the stack and thumbnail.
+	QList<int> used_list = used.toList();
+	QtConcurrent::blockingMap( used_list, [&]( int primitive ){
+			saved_primitives[primitive].save_compressed_size( format );
+		} );
+	double estimate = 0, payload_size = 0;
+	for( auto primitive : used_list ){
+		estimate += estimates[primitive];
+		payload_size += saved_primitives[primitive].compressed_size( format, Format::HIGH );
+	}
+	out.set( "payload_size", payload_size );
+	
+	//With a precision above 0 the layering was chosen from gradient sums, which are not bytes
+	if( format.get_precision() == 0 ){
+		out.set( "estimated_size", estimate );
+		if( estimate > 0 )
+			out.set( "estimate_error", ( payload_size - estimate ) / estimate );
+	}
+	else
+		out.set( "estimated_gradient", estimate );
+	
+	{	StageTimer timer( "validation" );
+		if( !validate( saved_primitives, final_frames ) ){
+			qWarning( "Optimized frames do not reconstruct the original images, not saving" );
+			return false;
+		}
+	}
+	
+	//The image plug-in can't decode add-offset layers, the frames have
+	//already been checked in memory above
+	auto check_file = [&]( QString path ){
+			if( format.get_add_offset() )
+				return true;
+			if( !QImageReader::supportedImageFormats().contains( "cgcompress" ) ){
+				qWarning( "The cgCompress plug-in is not installed, only the frames in memory were validated" );
+				return true;
+			}
+			StageTimer timer( "file_validation" );
+			if( !validate( path ) ){
+				qWarning( "The written file does not decode to the original images, not saving" );
+				return false;
+			}
+			return true;
+		};
+	if( !OraSaver( saved_primitives, final_frames ).save( name + ".cgcompress", format, check_file ) )
+		return false;
+	
+	out.set( "output_size", double( QFileInfo( name + ".cgcompress" ).size() ) );
 	return true;
 }
 
@@ -339,6 +811,7 @@ bool MultiImage::optimize3( QString name ) const{
 	done << starting_image;
 	
 	//Add the remaining images
+	StageTimer converter_timer( "converters" );
 	for( int i=1; i<originals.size(); i++ ){
 		//Create all needed converters
 		QList<ConverterPara> converter_para;
@@ -354,6 +827,8 @@ bool MultiImage::optimize3( QString name ) const{
 		done << best_it->get_to();
 	}
 	
+	converter_timer.stop();
+	
 	//Fix the order
 	qSort( used_converters.begin(), used_converters.end(), Converter::less_to );
 	
@@ -361,21 +836,31 @@ bool MultiImage::optimize3( QString name ) const{
 	//Get all images for saving
 	QList<Image> primitives;
 	for( auto converter : used_converters )
-		primitives << converter.get_primitive().auto_crop();
+		primitives << converter.get_cropped_primitive();
 	
 	//Get all paths from starting_image to each frame
 	QList<Frame> frames;
 	for( int i=0; i<originals.size(); i++ )
-		frames << Frame( primitives, Converter::path( used_converters, i, starting_image ) );
+		frames << Frame( Converter::path( used_converters, i, starting_image ) );
 	
-	reuse_planes( primitives, frames );
+	{	StageTimer timer( "reuse_planes" );
+		ImageStore store;
+		store << primitives;
+		reuse_planes( store, frames );
+		for( int i=0; i<store.size(); i++ )
+			primitives[i] = store[i];
+	}
 	
-	auto future2 = QtConcurrent::map( primitives, [&]( auto& img ){ img = img.optimize_filesize( format ); } );
-	ProgressBar::showFuture( "Optimizing images", future2 );
+	{	StageTimer timer( "optimize_filesize" );
+		auto future2 = QtConcurrent::map( primitives, [&]( auto& img ){
+				Trace::Span span( "optimize_filesize" );
+				img = img.optimize_filesize( format );
+			} );
+		ProgressBar::showFuture( "Optimizing images", future2 );
+	}
 	
 	//Save cgCompress image
-	OraSaver( primitives, frames ).save( name + ".cgcompress", format );
-	return true;
+	return OraSaver( primitives, frames ).save( name + ".cgcompress", format );
 }
 
 
@@ -383,7 +868,7 @@ bool MultiImage::optimize3( QString name ) const{
  *  \param [in] file File path for file to validate
  */
 bool MultiImage::validate( QString file ) const{
-	QImageReader reader( file );
+	QImageReader reader( file, "cgcompress" );
 	
 	QImage current;
 	for( int i=0; i<originals.count(); i++ ){
@@ -405,3 +890,21 @@ bool MultiImage::validate( QString file ) const{
 	return !reader.read( &current );
 }
 
+/** \return True if **frames** reconstructs this MultiImage exactly
+ *  \param [in] primitives The primitives used by the frames
+ *  \param [in] frames The frames to reconstruct
+ */
+bool MultiImage::validate( const QList<Image>& primitives, const QList<Frame>& frames ) const{
+	if( frames.size() != originals.size() )
+		return false;
+	
+	FrameCache cache( primitives, frames );
+	for( int i=0; i<frames.size(); i++ ){
+		if( cache.reconstruct( frames[i].layers ).qimg() != originals[i].qimg() ){
+			qDebug( "Frame %d does not match the original!", i+1 );
+			return false;
+		}
+	}
+	
+	return true;
+}
@@ -20,7 +20,9 @@
 
 #include "Format.hpp"
 #include "Image.hpp"
+#include "ImageStore.hpp"
 #include "Frame.hpp"
+#include "RunReport.hpp"
 
 #include <utility>
 
@@ -28,14 +30,15 @@
 class MultiImage {
 	public:
 		Format format;
-		QList<Image> originals;
+		ImageStore originals;
 		
 	public:
 		/** Construct with images initialized
 		 *  \param [in] format The image format to use
-		 *  \param [in] originals The images which it is made of
+		 *  \param [in] originals The images which it is made of, the budget
+		 *  of the store also limits the images created while optimizing
 		 */
-		MultiImage( Format format, QList<Image> originals=QList<Image>() )
+		MultiImage( Format format, ImageStore originals=ImageStore() )
 			: format(format), originals(originals){ }
 			
 		int count() const{ return originals.count(); }
@@ -43,11 +46,12 @@ class MultiImage {
 		/** \param [in] original Another image that it is made of */
 		void append( Image original ){ originals.append( original ); }
 		
-		bool optimize( QString name ) const;
+		bool optimize( QString name, RunReport* report=nullptr ) const;
 		bool optimize2( QString name ) const;
 		bool optimize3( QString name ) const;
 		
 		bool validate( QString file ) const;
+		bool validate( const QList<Image>& primitives, const QList<Frame>& frames ) const;
 };
 
 #endif
@@ -16,17 +16,22 @@
 */
 
 #include "OraSaver.hpp"
+#include "FileUtils.hpp"
+#include "FrameCache.hpp"
 #include "ProgressBar.hpp"
+#include "StageTimer.hpp"
 
+#include <QDir>
 #include <QFileInfo>
 #include <QDateTime>
+#include <QTemporaryFile>
 
 /** Construct an unoptimized cgCompress file from a set of images.
  *  
  *  \param [in] images The images to form individual frames
  */
 OraSaver::OraSaver( QList<Image> images ) : primitives( images ){
-	Frame frame( primitives, {} );
+	Frame frame( {} );
 	for( int i=0; i<images.size(); i++ )
 		frame.layers.append( i );
 	frames.append( frame );
@@ -65,11 +70,14 @@ bool addByteArray( zipFile &zf, QString name, QByteArray arr, int compression=0
 		,	NULL, 0, 0  // password, crcFile, zip64);
 		);
 	
+	if( err != ZIP_OK )
+		return false;
+	
 	//Write file
-	zipWriteInFileInZip( zf, arr.constData(), arr.size() );
+	bool written = zipWriteInFileInZip( zf, arr.constData(), arr.size() ) == ZIP_OK;
 	
 	//Finish file
-	return zipCloseFileInZip( zf ) == ZIP_OK;;
+	return zipCloseFileInZip( zf ) == ZIP_OK && written;
 }
 
 bool addStringFile( zipFile &zf, QString name, QString contents, bool compress=false ){
@@ -82,37 +90,70 @@ bool addStringFile( zipFile &zf, QString name, QString contents, bool compress=f
  *  \param [in] mimetype The contents of "mimetype" which will be STORED
  *  \param [in] stack The contents of "stack.xml"
  *  \param [in] files File names and contents of the files
+ *  \param [in] check If set, the output is only replaced if it accepts the written file
+ *  \return true if **path** was replaced with the new archive
  */
-void OraSaver::save( QString path, QString mimetype, QString stack, QList<std::pair<QString,QByteArray>> files ){
+bool OraSaver::save( QString path, QString mimetype, QString stack, QList<std::pair<QString,QByteArray>> files, Check check ){
+	//Reserve a unique name in the same directory, so the rename is atomic
+	QFileInfo info( path );
+	QTemporaryFile temp( info.absoluteDir().filePath( "." + info.fileName() + ".XXXXXX.tmp" ) );
+	if( !temp.open() ){
+		qWarning( "OraSaver: could not create a temporary file for '%s'", path.toLocal8Bit().constData() );
+		return false;
+	}
+	auto temp_path = temp.fileName();
+	temp.close();
+	
 	//TODO: make wrapper class for zipFile
-	zipFile zf = zipOpen64( path.toLocal8Bit().constData(), 0 );
+	zipFile zf = zipOpen64( QFile::encodeName( temp_path ).constData(), 0 );
+	if( !zf ){
+		qWarning( "OraSaver: could not open '%s'", temp_path.toLocal8Bit().constData() );
+		return false;
+	}
 	
 	//Save mimetype without compression
-	addStringFile( zf, "mimetype", mimetype );
+	bool written = addStringFile( zf, "mimetype", mimetype );
 	
 	//Save stack with compression
-	addStringFile( zf, "stack.xml", stack, true );
+	written = written && addStringFile( zf, "stack.xml", stack, true );
 	
 	//Save all data files
 	for( auto file : files )
-		addByteArray( zf, file.first, file.second );
+		written = written && addByteArray( zf, file.first, file.second );
 		//TODO: compress if there are significant savings. Perhaps user defined threshold?
 	
-	zipClose( zf, NULL );
+	written = zipClose( zf, NULL ) == ZIP_OK && written;
+	if( !written || !sync_file( temp_path ) ){
+		qWarning( "OraSaver: could not write '%s'", temp_path.toLocal8Bit().constData() );
+		return false;
+	}
+	
+	if( check && !check( temp_path ) )
+		return false;
+	
+	if( !replace_file( temp_path, path ) ){
+		qWarning( "OraSaver: could not replace '%s'", path.toLocal8Bit().constData() );
+		return false;
+	}
+	temp.setAutoRemove( false );
+	return true;
 }
 
 /** Save the current frames as a cgCompress file.
  *  
  *  \param [in] path File path for output file
  *  \param [in] format Format for compressing the image files
+ *  \param [in] check If set, the output is only replaced if it accepts the written file
+ *  \return true if **path** was replaced with the new archive
  */
-void OraSaver::save( QString path, Format format ) const{
+bool OraSaver::save( QString path, Format format, Check check ) const{
 	if( frames.isEmpty() ){
 		qWarning( "OraSaver: no frames to save!" );
-		return;
+		return false;
 	}
 	
-	auto first_frame = frames.first().reconstruct();
+	StageTimer encoding( "encoding" );
+	auto first_frame = FrameCache( primitives, frames ).reconstruct( frames.first().layers );
 	
 	QList<std::pair<QString,QByteArray>> files;
 	
@@ -146,7 +187,8 @@ void OraSaver::save( QString path, Format format ) const{
 		for( auto layer : boost::adaptors::reverse(frame.layers) ){
 			//Detect composition mode
 			//TODO: Decide this earlier and change encoding type
-			QString composition = "composite-op=\"cgcompress:alpha-replace\"";
+			QString composition = QString( "composite-op=\"%1\"" )
+				.arg( Blending::composite_op( primitives[layer].blend_mode() ) );
 		//	if( !primitives[layer].mustKeepAlpha() )
 		//		composition = "";
 			
@@ -163,7 +205,9 @@ void OraSaver::save( QString path, Format format ) const{
 	}
 	
 	stack += "</image>";
+	encoding.stop();
 	
 	//Save zip archive
-	save( path, "image/openraster", stack, files );
+	StageTimer zip( "zip" );
+	return save( path, "image/openraster", stack, files, check );
 }
@@ -22,12 +22,16 @@
 #include "Image.hpp"
 #include "Frame.hpp"
 
+#include <functional>
 #include <utility>
 
 /** Save images in a zip archive using the OpenRaster conventions.
  *  This means, STORED mimetype file as the first file, stack.xml file
  *  describing the image contents, a thumbnail in Thumbnails/thumbnail.*,
  *  and data files in data/.
+ *  
+ *  The archive is written to a temporary file next to the output, which
+ *  replaces the output once it is complete, so a partial file is never seen.
  */
 class OraSaver {
 	private:
@@ -41,9 +45,12 @@ class OraSaver {
 			:	primitives(primitives), frames(frames) { }
 		OraSaver( QList<Image> images );
 		
-		void save( QString path, Format format ) const;
+		/// Checks the temporary file before it replaces the output, given its path
+		using Check = std::function<bool( QString )>;
 		
-		static void save( QString path, QString mimetype, QString stack, QList<std::pair<QString,QByteArray>> files );
+		bool save( QString path, Format format, Check check=nullptr ) const;
+		
+		static bool save( QString path, QString mimetype, QString stack, QList<std::pair<QString,QByteArray>> files, Check check=nullptr );
 };
 
 #endif
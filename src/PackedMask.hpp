@@ -0,0 +1,297 @@
+/*
+	This file is part of cgCompress.
+	
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PACKED_MASK_HPP
+#define PACKED_MASK_HPP
+
+#include <QSize>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/** \return The amount of set bits in **value** */
+inline int popcount( uint64_t value ){
+#if defined(__GNUC__)
+	return __builtin_popcountll( value );
+#else
+	value = value - ((value >> 1) & 0x5555555555555555ull);
+	value = (value & 0x3333333333333333ull) + ((value >> 2) & 0x3333333333333333ull);
+	value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+	return (value * 0x0101010101010101ull) >> 56;
+#endif
+}
+
+/** A mask with **Bits** bits per pixel, packed into 64-bit words.
+ *  Each row starts on a new word, and the unused bits at the end of a row are
+ *  always zero. Operations on whole words work on 64/Bits pixels at a time.
+ *  Copies share the data until one of them is modified, like QImage.
+ *
+ *  Word operations use "slot masks", where only the lowest bit of each
+ *  pixel is used, making them usable for both 1 and 2 bit masks.
+ */
+template<int Bits>
+class PackedMask{
+	public:
+		using Word = uint64_t;
+		static const int BITS = Bits;
+		static const int PER_WORD = 64 / Bits;
+		static const Word PIXEL = (Word(1) << Bits) - 1;
+		/// The lowest bit of every pixel set
+		static const Word LOW = (Bits == 1) ? ~Word(0) : 0x5555555555555555ull;
+		
+		static const int VALUES = 1 << Bits;
+		
+	private:
+		struct Data{
+			std::vector<Word> words;
+			/// Amount of pixels with each value, -1 if not calculated yet
+			std::atomic<int> counts[VALUES];
+			
+			Data( std::size_t size ) : words( size, 0 ) { invalidate(); }
+			Data( const Data& other ) : words( other.words ) {
+				for( int i=0; i<VALUES; i++ )
+					counts[i] = other.counts[i].load();
+			}
+			void invalidate(){
+				for( auto& count : counts )
+					count = -1;
+			}
+		};
+		
+		std::shared_ptr<Data> data;
+		int w{ 0 };
+		int h{ 0 };
+		int stride{ 0 };
+		
+		/** Make sure the data is not shared before modifying it,
+		 *  and forget the cached counts */
+		void detach(){
+			if( !data )
+				return;
+			if( data.use_count() > 1 )
+				data = std::make_shared<Data>( *data );
+			data->invalidate();
+		}
+		
+	public:
+		/** \return Slot mask of the pixels in [**start**,**end**) of a word */
+		static Word range( int start, int end ){
+			auto below = []( int n ){
+				if( n <= 0 )
+					return Word(0);
+				return (n >= PER_WORD) ? ~Word(0) : (Word(1) << (n * Bits)) - 1;
+			};
+			return LOW & below( end ) & ~below( start );
+		}
+		
+		PackedMask() { }
+		PackedMask( int width, int height, unsigned value=0 )
+			:	w(width), h(height), stride( (width + PER_WORD - 1) / PER_WORD ) {
+			if( !isNull() ){
+				data = std::make_shared<Data>( stride * height );
+				fill( value );
+			}
+		}
+		PackedMask( QSize size, unsigned value=0 ) : PackedMask( size.width(), size.height(), value ) { }
+		
+		bool isNull() const{ return w <= 0 || h <= 0; }
+		int width()  const{ return w; }
+		int height() const{ return h; }
+		QSize size() const{ return { w, h }; }
+		
+		/** \return The amount of words in each row */
+		int words() const{ return stride; }
+		
+		/** \return Slot mask of the pixels in use in word **index** of a row */
+		Word used( int index ) const{ return range( 0, w - index * PER_WORD ); }
+		
+		/** Pointers returned by the non-const row() must not be used to
+		 *  modify the mask after calling count(), as it is cached */
+		const Word* row( int iy ) const{ return data->words.data() + iy * stride; }
+		Word* row( int iy ){ detach(); return data->words.data() + iy * stride; }
+		const Word* constRow( int iy ) const{ return row( iy ); }
+		
+		/** \return The value of pixel **ix** in a row from row() */
+		static unsigned get( const Word* row, int ix )
+			{ return (row[ix / PER_WORD] >> ((ix % PER_WORD) * Bits)) & PIXEL; }
+		unsigned get( int ix, int iy ) const{ return get( row( iy ), ix ); }
+		
+		void set( int ix, int iy, unsigned value ){
+			auto& word = row( iy )[ix / PER_WORD];
+			auto shift = (ix % PER_WORD) * Bits;
+			word = (word & ~(PIXEL << shift)) | (Word(value & PIXEL) << shift);
+		}
+		
+		/** Overwrite a row, one word at a time
+		 *  \param [in] iy The row to write
+		 *  \param [in] func Returns the value of the pixel at the given x position */
+		template<typename Func>
+		void setRow( int iy, Func func ){
+			auto out = row( iy );
+			for( int i=0; i<stride; i++ ){
+				Word word = 0;
+				auto start = i * PER_WORD, end = std::min( start + PER_WORD, w );
+				for( int ix=start; ix<end; ix++ )
+					word |= Word(func( ix ) & PIXEL) << ((ix - start) * Bits);
+				out[i] = word;
+			}
+		}
+		
+		/** \return A word with **value** in all pixels of **slots** */
+		static Word spread( Word slots, unsigned value ){ return slots * value; }
+		
+		/** \return All bits of the pixels in **slots** */
+		static Word widen( Word slots ){ return (Bits == 1) ? slots : slots | (slots << 1); }
+		
+		/** \return Pixels of **a** where **slots** is set, and **b** elsewhere */
+		static Word select( Word slots, Word a, Word b )
+			{ auto m = widen( slots ); return (a & m) | (b & ~m); }
+			
+		/** \return Slot mask of the pixels in **word** which equals **value** */
+		static Word matches( Word word, unsigned value ){
+			auto diff = word ^ spread( LOW, value );
+			return (Bits == 1) ? ~diff : ~(diff | (diff >> 1)) & LOW;
+		}
+		
+		void fill( unsigned value ){
+			if( isNull() )
+				return;
+			detach();
+			for( int iy=0; iy<h; iy++ ){
+				auto out = data->words.data() + iy * stride;
+				for( int i=0; i<stride; i++ )
+					out[i] = spread( used( i ), value );
+			}
+			
+			//All counts are known now
+			for( int i=0; i<VALUES; i++ )
+					data->counts[i] = (unsigned(i) == (value & PIXEL)) ? w * h : 0;
+		}
+		
+		/** Count the amount of pixels with each value in a single pass.
+		 *  The result is cached until the mask is modified.
+		 *  \return The amount of pixels with **value** */
+		int count( unsigned value ) const{
+			if( isNull() )
+				return 0;
+			
+			int cached = data->counts[value & PIXEL].load();
+			if( cached >= 0 )
+				return cached;
+			
+			int amounts[VALUES] = { 0 };
+			for( int iy=0; iy<h; iy++ ){
+				auto in = row( iy );
+				for( int i=0; i<stride; i++ )
+					for( int v=0; v<VALUES; v++ )
+						amounts[v] += popcount( matches( in[i], v ) & used( i ) );
+			}
+			
+			for( int v=0; v<VALUES; v++ )
+				data->counts[v] = amounts[v];
+			return amounts[value & PIXEL];
+		}
+		
+		/** \return The amount of pixels with **value** in the rectangle
+		 *  starting at **x**,**y** with the size **width**x**height** */
+		int count( unsigned value, int x, int y, int width, int height ) const{
+			if( width <= 0 || height <= 0 )
+				return 0;
+			if( x == 0 && y == 0 && width == w && height == h )
+				return count( value );
+			
+			int first = x / PER_WORD, last = (x + width - 1) / PER_WORD;
+			int amount = 0;
+			for( int iy=y; iy<y+height; iy++ ){
+				auto in = row( iy );
+				for( int i=first; i<=last; i++ ){
+					auto area = range( x - i*PER_WORD, x + width - i*PER_WORD );
+					amount += popcount( matches( in[i], value ) & area );
+				}
+			}
+			return amount;
+		}
+		
+		/** Set all pixels where **other** is set, only for 1-bit masks
+		 *  \param [in] other Mask which must fit inside this mask
+		 *  \param [in] x Horizontal position of **other**
+		 *  \param [in] y Vertical position of **other** */
+		void combine( const PackedMask& other, int x=0, int y=0 ){
+			static_assert( Bits == 1, "PackedMask::combine() requires a 1-bit mask" );
+			if( other.isNull() )
+				return;
+			
+			auto shift = (x % PER_WORD) * Bits;
+			auto first = x / PER_WORD;
+			for( int iy=0; iy<other.h; iy++ ){
+				auto out = row( iy + y ) + first;
+				auto in = other.row( iy );
+				for( int i=0; i<other.stride; i++ ){
+					out[i] |= in[i] << shift;
+					if( shift > 0 && first + i + 1 < stride )
+						out[i+1] |= in[i] >> (64 - shift);
+				}
+			}
+		}
+		
+		/** Clear all pixels where **other** is not set, only for 1-bit masks
+		 *  \param [in] other Mask with the same size */
+		void intersect( const PackedMask& other ){
+			static_assert( Bits == 1, "PackedMask::intersect() requires a 1-bit mask" );
+			for( int iy=0; iy<h; iy++ ){
+				auto out = row( iy );
+				auto in = other.row( iy );
+				for( int i=0; i<stride; i++ )
+					out[i] &= in[i];
+			}
+		}
+		
+		/** \return A copy of the area starting at **x**,**y** */
+		PackedMask copy( int x, int y, int width, int height ) const{
+			PackedMask out( width, height );
+			auto shift = (x % PER_WORD) * Bits;
+			auto first = x / PER_WORD;
+			for( int iy=0; iy<height; iy++ ){
+				auto in = constRow( iy + y ) + first;
+				auto dst = out.row( iy );
+				for( int i=0; i<out.stride; i++ ){
+					Word word = in[i] >> shift;
+					if( shift > 0 && first + i + 1 < stride )
+						word |= in[i+1] << (64 - shift);
+					dst[i] = word & widen( out.used( i ) );
+				}
+			}
+			return out;
+		}
+		
+		bool operator==( const PackedMask& other ) const{
+			if( w != other.w || h != other.h )
+				return false;
+			return data == other.data || isNull() || data->words == other.data->words;
+		}
+		bool operator!=( const PackedMask& other ) const{ return !(*this == other); }
+};
+
+/** Mask with PIXEL_DIFFERENT, PIXEL_MATCH and PIXEL_SHARED values */
+using PixelMask = PackedMask<2>;
+/** Mask with true/false values */
+using BitMask = PackedMask<1>;
+
+#endif
@@ -0,0 +1,79 @@
+/*
+	This file is part of cgCompress.
+	
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PixelHashes.hpp"
+#include "SubQImage.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+static uint64_t rotate( uint64_t value, int amount )
+	{ return (value << amount) | (value >> (64-amount)); }
+
+/** Add 64 bits of data to the hash */
+static uint64_t mix( uint64_t hash, uint64_t value ){
+	hash ^= value * 0x9E3779B97F4A7C15ull;
+	return rotate( hash, 27 ) * 0xBF58476D1CE4E5B9ull + 0x94D049BB133111EBull;
+}
+
+/** Spread the bits of the hash, so similar input do not give similar hashes */
+static uint64_t finalize( uint64_t hash ){
+	hash ^= hash >> 31;
+	hash *= 0x7FB5D329728EA185ull;
+	hash ^= hash >> 27;
+	hash *= 0x81DADEF4BC2DD44Dull;
+	return hash ^ (hash >> 33);
+}
+
+/** Hash a span of pixels, two pixels at a time */
+static uint64_t hash_pixels( const QRgb* pixels, int amount ){
+	uint64_t hash = amount;
+	int ix = 0;
+	for( ; ix+1<amount; ix+=2 ){
+		uint64_t pair;
+		std::memcpy( &pair, pixels + ix, sizeof(pair) );
+		hash = mix( hash, pair );
+	}
+	if( ix < amount )
+		hash = mix( hash, pixels[ix] );
+	return finalize( hash );
+}
+
+/** Calculate all hashes in a single pass over the image
+ *  \param [in] img Image to hash */
+PixelHashes::PixelHashes( const SubQImage& img )
+	:	rows( img.height() )
+	,	columns( (img.width() + TILE_SIZE - 1) / TILE_SIZE )
+	{
+	auto width = img.width();
+	tiles.resize( columns * ((img.height() + TILE_SIZE - 1) / TILE_SIZE), 0 );
+	
+	for( int iy=0; iy<img.height(); iy++ ){
+		auto row = img.row( iy );
+		auto tile_row = tiles.data() + (iy / TILE_SIZE) * columns;
+		
+		//The row hash is made up of the hashes of each tile segment
+		uint64_t row_hash = width;
+		for( int tx=0; tx<columns; tx++ ){
+			auto start = tx * TILE_SIZE;
+			auto segment = hash_pixels( row + start, std::min( TILE_SIZE, width - start ) );
+			row_hash = mix( row_hash, segment );
+			tile_row[tx] = mix( tile_row[tx], segment );
+		}
+		rows[iy] = finalize( row_hash );
+	}
+}
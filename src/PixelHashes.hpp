@@ -0,0 +1,67 @@
+/*
+	This file is part of cgCompress.
+	
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PIXEL_HASHES_HPP
+#define PIXEL_HASHES_HPP
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class SubQImage;
+
+/** 64-bit hashes of each row and each tile of an image. Two images with the
+ *  same dimensions can skip comparing pixels in rows or tiles where the
+ *  hashes are equal. */
+class PixelHashes{
+	public:
+		static const int TILE_SIZE = 64;
+		
+	private:
+		std::vector<uint64_t> rows;
+		std::vector<uint64_t> tiles;
+		int columns{ 0 };
+		
+	public:
+		PixelHashes( const SubQImage& img );
+		
+		/** \return The hash of row **iy** */
+		uint64_t row( int iy ) const{ return rows[iy]; }
+		
+		/** \return The hash of the tile containing the pixel at **ix**,**iy** */
+		uint64_t tile( int ix, int iy ) const
+			{ return tiles[ (iy / TILE_SIZE) * columns + ix / TILE_SIZE ]; }
+};
+
+/** PixelHashes which are only calculated the first time they are needed.
+ *  Shared between copies of an Image, and safe to use from several threads. */
+class LazyPixelHashes{
+	private:
+		std::once_flag once;
+		std::unique_ptr<PixelHashes> hashes;
+		
+	public:
+		/** \param [in] img The image data, must be the same on each call
+		 *  \return The hashes of **img** */
+		const PixelHashes& get( const SubQImage& img ){
+			std::call_once( once, [&](){ hashes = std::make_unique<PixelHashes>( img ); } );
+			return *hashes;
+		}
+};
+
+#endif
@@ -18,15 +18,17 @@
 #ifndef PROGRESS_BAR_HPP
 #define PROGRESS_BAR_HPP
 
+#include <atomic>
 #include <string>
 #include <iostream>
 
+#include <QEventLoop>
 #include <QFuture>
-#include <QThread>
+#include <QFutureWatcher>
 
 /** Creates a progress bar on stdout with a title. Scope is used to stop the
  *  progress bar, do not output anything to stdout until the destructor is
- *  called */
+ *  called. Nothing is written in quiet mode. */
 class ProgressBar{
 	private:
 		int amount;
@@ -34,7 +36,18 @@ class ProgressBar{
 		int count{ 0 };
 		int written{ 0 };
 		
+		static std::atomic<bool>& quiet_mode(){
+			static std::atomic<bool> quiet{ false };
+			return quiet;
+		}
+		
 	public:
+		/** \param [in] quiet If true, no progress bars are shown, for batch jobs */
+		static void set_quiet( bool quiet ){ quiet_mode() = quiet; }
+		
+		/** \return true if progress bars are not shown */
+		static bool is_quiet(){ return quiet_mode(); }
+		
 		/** Create the progress bar
 		 *  
 		 *  \param [in] msg A title to be displayed together with the progress
@@ -42,7 +55,7 @@ class ProgressBar{
 		 *  \param [in] size The width of the progress bar
 		 */
 		ProgressBar( std::string msg, int amount, int size=60 ) : amount(amount), size(size){
-			if( amount > 0 ){
+			if( amount > 0 && !is_quiet() ){
 				//Print slightly fancy header with centered text
 				msg += " (" + std::to_string( amount ) + ")";
 				int left = size - msg.size();
@@ -60,33 +73,53 @@ class ProgressBar{
 			}
 		}
 		/** Stops and closes the progress bar */
-		~ProgressBar(){ std::cout << std::endl; }
+		~ProgressBar(){
+			if( !is_quiet() )
+				std::cout << std::endl;
+		}
 		
 		/** Advance the progress
 		 * \param [in] progress How much progress that have been made
 		 */
 		void update( int progress=1 ){
+			if( is_quiet() )
+				return;
 			for( count += progress; written < count*size/amount; written++ )
 				std::cout << "X";
 		}
 		
 		
-
+		/** Show the progress of **future** until it finishes. The progress is
+		 *  updated when the future reports it, which QFutureWatcher delivers as
+		 *  events, so an event loop runs until the future is finished.
+		 *  \param [in] description The title of the progress bar
+		 *  \param [in] future The work to wait for */
 		template<typename T>
 		static void showFuture( const char* description, QFuture<T>& future ){
-			ProgressBar progress( description, future.progressMaximum() - future.progressMinimum() );
+			if( is_quiet() ){
+				future.waitForFinished();
+				return;
+			}
 			
+			ProgressBar progress( description, future.progressMaximum() - future.progressMinimum() );
 			int last = future.progressMinimum();
-			while( !future.isFinished() ){
-				QThread::msleep( 10 );
-				int current = future.progressValue();
-				if( current > last ){
-					progress.update( current - last );
-					last = current;
-				}
-			}
+			auto advance = [&]( int current ){
+					if( current > last ){
+						progress.update( current - last );
+						last = current;
+					}
+				};
+			
+			QEventLoop loop;
+			QFutureWatcher<T> watcher;
+			QObject::connect( &watcher, &QFutureWatcherBase::progressValueChanged, advance );
+			QObject::connect( &watcher, &QFutureWatcherBase::finished, &loop, &QEventLoop::quit );
+			watcher.setFuture( future );
+			if( !future.isFinished() )
+				loop.exec();
 			
 			future.waitForFinished();
+			advance( future.progressValue() );
 		}
 };
 
@@ -0,0 +1,48 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "RunReport.hpp"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+
+/** Store the measured stages
+ *  \param [in] records The stages, from StageTimer::records() */
+void RunReport::set_stages( const QList<StageTimer::Record>& records ){
+	QJsonArray stages;
+	for( auto record : records ){
+		QJsonObject stage;
+		stage["name"] = record.name;
+		stage["wall_ms"] = record.wall_ms;
+		stage["cpu_ms"] = record.cpu_ms;
+		stages.append( stage );
+	}
+	values["stages"] = stages;
+}
+
+/** Write the report as a single line at the end of a file
+ *  \param [in] path The file to append to, created if it does not exist
+ *  \return true on success */
+bool RunReport::append_to( QString path ) const{
+	QFile file( path );
+	if( !file.open( QIODevice::WriteOnly | QIODevice::Append ) )
+		return false;
+	
+	auto line = QJsonDocument( values ).toJson( QJsonDocument::Compact ) + "\n";
+	return file.write( line ) == line.size();
+}
@@ -0,0 +1,45 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RUN_REPORT_HPP
+#define RUN_REPORT_HPP
+
+#include "StageTimer.hpp"
+
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QString>
+
+/** Facts about compressing a single image set, such as its dimensions, the
+ *  chosen layering and the time spent in each stage. Written as one line of
+ *  JSON, so the reports of many runs can be appended to the same file.
+ */
+class RunReport{
+	private:
+		QJsonObject values;
+		
+	public:
+		/** \param [in] key The name of the value
+		 *  \param [in] value The value to store, replacing any previous value */
+		void set( QString key, QJsonValue value ){ values[key] = value; }
+		
+		void set_stages( const QList<StageTimer::Record>& records );
+		
+		bool append_to( QString path ) const;
+};
+
+#endif
@@ -0,0 +1,58 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "StageTimer.hpp"
+#include "Trace.hpp"
+
+#include <QMutex>
+#include <QMutexLocker>
+
+std::atomic<long> StageTimer::allocated{ 0 };
+
+static QMutex records_lock;
+static QList<StageTimer::Record> finished;
+
+StageTimer::StageTimer( QString name )
+	:	name( name ), cpu( std::clock() ), allocations( allocated.load() ), trace_start( Trace::now() ) {
+	wall.start();
+}
+
+void StageTimer::stop(){
+	if( !running )
+		return;
+	running = false;
+	Trace::add( name, trace_start, Trace::now() );
+	
+	Record record{ name
+		,	wall.nsecsElapsed() / 1000000.0
+		,	(std::clock() - cpu) * 1000.0 / CLOCKS_PER_SEC
+		,	allocated.load() - allocations
+		};
+	
+	QMutexLocker locker( &records_lock );
+	finished.append( record );
+}
+
+QList<StageTimer::Record> StageTimer::records(){
+	QMutexLocker locker( &records_lock );
+	return finished;
+}
+
+void StageTimer::reset(){
+	QMutexLocker locker( &records_lock );
+	finished.clear();
+}
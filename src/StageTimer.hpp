@@ -0,0 +1,75 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STAGE_TIMER_HPP
+#define STAGE_TIMER_HPP
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QString>
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+
+/** Measures a stage of the optimization, from construction until stop() or
+ *  destruction. The measurements are collected globally, so tools such as
+ *  cgbench can read them after a run. The stage is also added to the trace,
+ *  if tracing is enabled.
+ */
+class StageTimer{
+	public:
+		struct Record{
+			QString name;
+			double wall_ms;     ///< Elapsed real time
+			double cpu_ms;      ///< CPU time of all threads in the process
+			long allocations;   ///< Calls to operator new, if counted
+		};
+		
+	private:
+		static std::atomic<long> allocated;
+		
+		QString name;
+		QElapsedTimer wall;
+		std::clock_t cpu;
+		long allocations;
+		int64_t trace_start;
+		bool running{ true };
+		
+	public:
+		/** Start measuring
+		 *  \param [in] name The name of the stage */
+		explicit StageTimer( QString name );
+		StageTimer( const StageTimer& ) = delete;
+		StageTimer& operator=( const StageTimer& ) = delete;
+		~StageTimer(){ stop(); }
+		
+		/** Stop measuring and store the record, does nothing if already stopped */
+		void stop();
+		
+		/** \return All stages measured since the last reset(), in the order they finished */
+		static QList<Record> records();
+		
+		/** Forget all records */
+		static void reset();
+		
+		/** Count an allocation. Only called if the executable replaces
+		 *  operator new to do so, as tools/cgbench does */
+		static void count_allocation(){ allocated.fetch_add( 1, std::memory_order_relaxed ); }
+};
+
+#endif
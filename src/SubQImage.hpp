@@ -22,19 +22,23 @@
 
 
 /** Provides ReadOnly access to a region of a QImage without copying.
+ *  The region is positioned independently of where it is in the QImage.
  *  row() and rowIndex() provides pixel access which is offset and casted correctly */
 class SubQImage{
 	private:
 		QImage img;
-		QPoint pos;
+		QPoint pos;   ///< Position of the region
+		QPoint start; ///< Top-left corner of the region in **img**
 		QSize subsize;
 		
 		auto scanLine( int iy ) const
-			{ return img.constScanLine( iy + pos.y() ); }
+			{ return img.constScanLine( iy + start.y() ); }
 		
-		SubQImage( QImage img, QPoint pos, QSize subsize )
-			:	img(img), pos(pos), subsize(subsize) {}
+		SubQImage( QImage img, QPoint pos, QPoint start, QSize subsize )
+			:	img(img), pos(pos), start(start), subsize(subsize) {}
 	public:
+		/** \param [in] img The pixels, all of them are part of the region
+		 *  \param [in] pos Position of the region */
 		SubQImage( QImage img, QPoint pos={0,0} )
 			:	img(img), pos(pos), subsize(img.size()) { }
 		
@@ -44,17 +48,27 @@ class SubQImage{
 		auto width()  const{ return size().width();  }
 		auto height() const{ return size().height(); }
 		
-		auto rowIndex( int iy ) const{ return               scanLine( iy )  + pos.x(); }
-		auto row(      int iy ) const{ return (const QRgb*)(scanLine( iy )) + pos.x(); }
+		auto rowIndex( int iy ) const{ return               scanLine( iy )  + start.x(); }
+		auto row(      int iy ) const{ return (const QRgb*)(scanLine( iy )) + start.x(); }
+		
+		/** \return Writable pixels of row **iy**, detaches the QImage if it is shared */
+		QRgb* writableRow( int iy ){ return (QRgb*)img.scanLine( iy + start.y() ) + start.x(); }
 		
 		auto get() const
-			{ return img.copy( pos.x(), pos.y(), width(), height() ); }
+			{ return img.copy( start.x(), start.y(), width(), height() ); }
 		
 		SubQImage copy( QPoint pos, QSize size ) const
-			{ return { img, offset() + pos, size }; }
+			{ return { img, offset() + pos, start + pos, size }; }
+		
+		/** \return A copy which only keeps the pixels of the region,
+		 *  so the rest of the QImage can be freed */
+		SubQImage compact() const
+			{ return subsize == img.size() ? *this : SubQImage( get(), pos ); }
 		
-		bool operator==( const SubQImage& other ) const
-			{	return img == other.img && pos == other.pos && subsize == other.subsize; }
+		bool operator==( const SubQImage& other ) const{
+			return img == other.img && pos == other.pos
+				&& start == other.start && subsize == other.subsize;
+		}
 };
 
 #endif
@@ -0,0 +1,89 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Trace.hpp"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <atomic>
+#include <vector>
+
+struct Event{
+	QString name;
+	int thread;
+	int64_t start;
+	int64_t end;
+};
+
+static std::atomic<bool> active{ false };
+static QElapsedTimer trace_clock;
+static QMutex events_lock;
+static std::vector<Event> events;
+
+/** \return A small number identifying the current thread, in order of first use */
+static int thread_number(){
+	static std::atomic<int> next{ 0 };
+	thread_local int number = next++;
+	return number;
+}
+
+void Trace::enable(){
+	if( !active ){
+		trace_clock.start();
+		active = true;
+	}
+}
+
+bool Trace::enabled(){ return active.load( std::memory_order_relaxed ); }
+
+int64_t Trace::now(){ return enabled() ? trace_clock.nsecsElapsed() : 0; }
+
+void Trace::add( QString name, int64_t start, int64_t end ){
+	if( !enabled() )
+		return;
+	Event event{ name, thread_number(), start, end };
+	
+	QMutexLocker locker( &events_lock );
+	events.push_back( event );
+}
+
+bool Trace::write( QString path ){
+	QFile file( path );
+	if( !file.open( QIODevice::WriteOnly ) )
+		return false;
+	
+	QMutexLocker locker( &events_lock );
+	
+	//Timestamps are in microseconds, "X" events have both start and duration
+	QByteArray json( "{\"traceEvents\":[\n" );
+	for( unsigned i=0; i<events.size(); i++ ){
+		auto& event = events[i];
+		json += QString( "{\"name\":\"%1\",\"ph\":\"X\",\"pid\":1,\"tid\":%2,\"ts\":%3,\"dur\":%4}%5\n" )
+			.arg( event.name )
+			.arg( event.thread )
+			.arg( event.start / 1000.0, 0, 'f', 3 )
+			.arg( (event.end - event.start) / 1000.0, 0, 'f', 3 )
+			.arg( i+1 < events.size() ? "," : "" )
+			.toUtf8();
+	}
+	json += "],\"displayTimeUnit\":\"ms\"}\n";
+	
+	return file.write( json ) == json.size();
+}
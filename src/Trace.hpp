@@ -0,0 +1,71 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <QString>
+
+#include <cstdint>
+
+/** Records spans of work on each thread, written out in the Chrome
+ *  trace-event format, which can be viewed in chrome://tracing or Perfetto.
+ *  Nothing is recorded unless enable() have been called.
+ */
+namespace Trace{
+
+/** Start recording spans */
+void enable();
+
+/** \return true if spans are being recorded */
+bool enabled();
+
+/** \return Nanoseconds since the trace clock started */
+int64_t now();
+
+/** Record a span on the current thread
+ *  \param [in] name The name of the span
+ *  \param [in] start Result of now() when the span started
+ *  \param [in] end Result of now() when the span ended */
+void add( QString name, int64_t start, int64_t end );
+
+/** Write all the recorded spans
+ *  \param [in] path Where to save the trace
+ *  \return true on success */
+bool write( QString path );
+
+/** Records a span from construction until destruction. Cheap enough to be
+ *  used in every task of a QtConcurrent call. */
+class Span{
+	private:
+		const char* name;
+		int64_t start;
+		
+	public:
+		/** \param [in] name The name of the span, must outlive the span */
+		explicit Span( const char* name ) : name( name ), start( enabled() ? now() : -1 ) { }
+		Span( const Span& ) = delete;
+		Span& operator=( const Span& ) = delete;
+		~Span(){
+			if( start >= 0 )
+				add( name, start, now() );
+		}
+};
+
+}
+
+#endif
@@ -0,0 +1,166 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "VirtualAncestors.hpp"
+
+#include <algorithm>
+#include <vector>
+
+/** Minimum amount of frames which must share an ancestor */
+const int MIN_MEMBERS = 3;
+
+/** \return For each pixel the value most images have, using a Boyer-Moore
+ *  majority vote. If no value is in the majority, any of them is used.
+ *  Only one image is accessed at a time, so they can be evicted from **images** */
+static QImage consensus( const ImageStore& images ){
+	auto size = images.first().get_rect().size();
+	QImage out( size, QImage::Format_ARGB32 );
+	std::vector<int> votes( size.width() * size.height(), 0 );
+	
+	for( int i=0; i<images.size(); i++ ){
+		auto image = images[i];
+		for( int iy=0; iy<size.height(); iy++ ){
+			auto out_row = (QRgb*)out.scanLine( iy );
+			auto row_votes = votes.data() + iy * size.width();
+			auto in = image.row( iy );
+			for( int ix=0; ix<size.width(); ix++ ){
+				if( row_votes[ix] == 0 )
+					out_row[ix] = in[ix];
+				row_votes[ix] += (out_row[ix] == in[ix]) ? 1 : -1;
+			}
+		}
+	}
+	
+	return out;
+}
+
+/** \return The hash of each tile in **image**, row by row */
+static std::vector<uint64_t> tile_hashes( const Image& image ){
+	std::vector<uint64_t> tiles;
+	auto hashes = image.pixel_hashes();
+	auto size = image.get_rect().size();
+	for( int y=0; y<size.height(); y+=PixelHashes::TILE_SIZE )
+		for( int x=0; x<size.width(); x+=PixelHashes::TILE_SIZE )
+			tiles.push_back( hashes->tile( x, y ) );
+	return tiles;
+}
+
+/** Create an ancestor for a group of images
+ *  \param [in] images The images to create the ancestor from
+ *  \param [in] members Indexes to the images in the group
+ *  \param [in] base The image to use where the images do not agree
+ *  \return **base**, but with the pixels all the members agree on */
+static QImage common_ancestor( const ImageStore& images, const QList<int>& members, const QImage& base ){
+	QImage out = base.copy();
+	int width = out.width();
+	std::vector<uint8_t> agree( width * out.height(), 1 );
+	
+	//Compare one member at a time against the first one
+	auto first = images[members.first()];
+	for( auto member : members ){
+		auto image = images[member];
+		for( int iy=0; iy<out.height(); iy++ ){
+			auto row_agree = agree.data() + iy * width;
+			auto first_row = first.row( iy );
+			auto in = image.row( iy );
+			for( int ix=0; ix<width; ix++ )
+				row_agree[ix] &= first_row[ix] == in[ix];
+		}
+	}
+	
+	for( int iy=0; iy<out.height(); iy++ ){
+		auto out_row = (QRgb*)out.scanLine( iy );
+		auto row_agree = agree.data() + iy * width;
+		auto first_row = first.row( iy );
+		for( int ix=0; ix<width; ix++ )
+			out_row[ix] = row_agree[ix] ? first_row[ix] : out_row[ix];
+	}
+	
+	return out;
+}
+
+/** Find images which are not in the set, but which several of the images could
+ *  be efficiently created from. When the images vary in several independent ways,
+ *  like outfit and expression, none of the originals might be a good shared base.
+ *  
+ *  The first candidate is the consensus of all images. The images are then
+ *  clustered by which tiles they change compared to the consensus, and for
+ *  each cluster the pixels they all agree on are applied to the consensus.
+ *  \param [in] originals The images in the set, which must all have the same size
+ *  \return The ancestors, which do not match any of the originals */
+QList<Image> find_virtual_ancestors( const ImageStore& originals ){
+	QList<Image> ancestors;
+	if( originals.size() < MIN_MEMBERS )
+		return ancestors;
+	
+	auto rect = originals.first().get_rect();
+	std::vector<std::vector<uint64_t>> tiles;
+	for( int i=0; i<originals.size(); i++ ){
+		auto original = originals[i];
+		if( original.get_rect() != rect || !original.pixel_hashes() )
+			return ancestors;
+		tiles.push_back( tile_hashes( original ) );
+	}
+	
+	//Skip ancestors which already are in the set
+	auto add_ancestor = [&]( QImage ancestor ){
+			Image image( {0,0}, ancestor );
+			auto hashes = tile_hashes( image );
+			for( int i=0; i<originals.size(); i++ )
+				if( hashes == tiles[i] && originals[i].qimg() == ancestor )
+					return;
+			ancestors << image;
+		};
+	
+	auto base = consensus( originals );
+	add_ancestor( base );
+	auto base_tiles = tile_hashes( Image( {0,0}, base ) );
+	
+	//Find the tiles where each image differs from the consensus
+	std::vector<std::vector<int>> changed( originals.size() );
+	for( int i=0; i<originals.size(); i++ )
+		for( unsigned t=0; t<base_tiles.size(); t++ )
+			if( tiles[i][t] != base_tiles[t] )
+				changed[i].push_back( t );
+	
+	//Cluster images where at least half of the changed tiles are identical
+	std::vector<bool> clustered( originals.size(), false );
+	for( int i=0; i<originals.size(); i++ ){
+		if( clustered[i] || changed[i].empty() )
+			continue;
+		
+		QList<int> members{ i };
+		for( int j=i+1; j<originals.size(); j++ ){
+			if( clustered[j] )
+				continue;
+			
+			unsigned agree = std::count_if( changed[i].begin(), changed[i].end()
+				,	[&]( int t ){ return tiles[i][t] == tiles[j][t]; } );
+			if( agree * 2 >= changed[i].size() )
+				members << j;
+		}
+		
+		if( members.size() < MIN_MEMBERS )
+			continue;
+		
+		for( auto member : members )
+			clustered[member] = true;
+		add_ancestor( common_ancestor( originals, members, base ) );
+	}
+	
+	return ancestors;
+}
@@ -15,14 +15,14 @@
 	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#ifndef IMAGE_OPTIM_HPP
-#define IMAGE_OPTIM_HPP
+#ifndef VIRTUAL_ANCESTORS_HPP
+#define VIRTUAL_ANCESTORS_HPP
 
-class QImage;
+#include "Image.hpp"
+#include "ImageStore.hpp"
 
-void ImageDiff( QImage img1, QImage img2, int diff_amount );
-void ImageDiffCombine( QImage base, QImage diff, QImage overlay );
+#include <QList>
 
+QList<Image> find_virtual_ancestors( const ImageStore& originals );
 
 #endif
-
@@ -0,0 +1,11 @@
+# cgCompress sources shared by the application and the tools, except main.cpp
+INCLUDEPATH += $$PWD
+QT += concurrent
+
+LIBS += -lz -llz4 -llzma
+
+HEADERS += $$PWD/Blending.hpp $$PWD/Compression.hpp $$PWD/CsvWriter.hpp $$PWD/Image.hpp $$PWD/Frame.hpp $$PWD/FrameCache.hpp $$PWD/ImageSimilarities.hpp $$PWD/ImageStore.hpp $$PWD/Journal.hpp $$PWD/MultiImage.hpp $$PWD/Converter.hpp $$PWD/OraSaver.hpp $$PWD/FileUtils.hpp $$PWD/FrameStore.hpp $$PWD/Format.hpp $$PWD/FileSizeEval.hpp $$PWD/PackedMask.hpp $$PWD/PixelHashes.hpp $$PWD/ProgressBar.hpp $$PWD/RunReport.hpp $$PWD/StageTimer.hpp $$PWD/Trace.hpp $$PWD/VirtualAncestors.hpp
+SOURCES += $$PWD/Blending.cpp $$PWD/Compression.cpp $$PWD/CsvWriter.cpp $$PWD/Image.cpp $$PWD/Frame.cpp $$PWD/FrameCache.cpp $$PWD/ImageSimilarities.cpp $$PWD/ImageStore.cpp $$PWD/Journal.cpp $$PWD/MultiImage.cpp $$PWD/Converter.cpp $$PWD/OraSaver.cpp $$PWD/FileUtils.cpp $$PWD/FrameStore.cpp $$PWD/Format.cpp $$PWD/FileSizeEval.cpp $$PWD/PixelHashes.cpp $$PWD/RunReport.cpp $$PWD/StageTimer.cpp $$PWD/Trace.cpp $$PWD/VirtualAncestors.cpp
+
+# minizip
+SOURCES += $$PWD/minizip/ioapi.cpp $$PWD/minizip/zip.cpp
@@ -19,14 +19,22 @@
 #include <QStringList>
 #include <QFileInfo>
 #include <QImageReader>
+#include <QMap>
 #include <QDebug>
+#include <QtConcurrent>
 
 #include "Format.hpp"
 #include "MultiImage.hpp"
 #include "FileUtils.hpp"
-#include "ImageOptim.hpp"
+#include "FrameStore.hpp"
+#include "Journal.hpp"
+#include "ProgressBar.hpp"
+#include "RunReport.hpp"
+#include "StageTimer.hpp"
+#include "Trace.hpp"
 
 #include <iostream>
+#include <memory>
 using namespace std;
 
 /** Print version number to stdout */
@@ -51,6 +59,15 @@ static void print_help(){
 	cout << "\t" << "--noalpha      Remove alpha channel from input images" << endl;
 	cout << "\t" << "--discard-transparent  Remove pixel values from transparent pixels" << endl;
 	cout << "\t" << "--evaluate     Write a CSV file which evaluates filesize compared to other formats" << endl;
+	cout << "\t" << "--add-offset   Store small colour changes as offsets, not supported by older decoders" << endl;
+	cout << "\t" << "--virtual-ancestors  Let frames branch from the pixels they share, slower" << endl;
+	cout << "\t" << "--trace=XXX    Write the time spent in each stage and thread to XXX, in the Chrome trace format" << endl;
+	cout << "\t" << "--report=XXX   Append a line of JSON describing each compressed set to XXX" << endl;
+	cout << "\t" << "--quiet        Do not show progress, for batch jobs" << endl;
+	cout << "\t" << "--memory-limit=X  Keep at most X MiB of decoded images in memory, the rest is cached on disk" << endl;
+	cout << "\t" << "--frame-store=XXX Keep the decoded input images in directory XXX, so they are only decoded once" << endl;
+	cout << "\t" << "--journal=XXX  Record each compressed set in the journal XXX" << endl;
+	cout << "\t" << "--resume       Skip sets recorded in the journal, which defaults to cgcompress.journal" << endl;
 }
 
 /** Retrieves XXX from --name=XXX
@@ -96,13 +113,28 @@ static int parse_int( QString input, int default_value=0 ){
 	return default_value;
 }
 
-static int optimizeImage( MultiImage& img, QString output_path ){
-	img.optimize( output_path );
-	if( !img.validate( output_path ) ){
-		//Issue with file, don't convert
+/** Compress an image set and check the result
+ *  \param [in] img The images to compress
+ *  \param [in] output_path Where to save it, without the extension
+ *  \param [in] report_path Append a RunReport to this file, unless empty
+ *  \return 0 on success */
+static int optimizeImage( MultiImage& img, QString output_path, QString report_path ){
+	Trace::Span span( "image_set" );
+	StageTimer::reset();
+	RunReport report;
+	report.set( "name", output_path );
+	
+	//optimize() validates the file before it replaces any existing output
+	bool valid = img.optimize( output_path, &report );
+	
+	report.set( "success", valid );
+	report.set_stages( StageTimer::records() );
+	if( !report_path.isEmpty() && !report.append_to( report_path ) )
+		qWarning( "Could not write report to '%s'", report_path.toLocal8Bit().constData() );
+	
+	if( !valid ){
+		//Nothing was written, so continue with the next set
 		cout << "Resulting file did not pass validity check!\n";
-		QFile::remove( output_path );
-		std::getchar();
 		return -1;
 	}
 	return 0;
@@ -126,6 +158,20 @@ int main( int argc, char* argv[] ){
 	
 	//Get quality
 	format.set_precision( parse_int( get_option_value( options, "quality" ), 1 ) );
+	format.set_add_offset( options.contains( "--add-offset" ) );
+	format.set_virtual_ancestors( options.contains( "--virtual-ancestors" ) );
+	
+	//Record where the time is spent
+	auto trace_path = get_option_value( options, "trace" );
+	if( !trace_path.isEmpty() )
+		Trace::enable();
+	auto report_path = get_option_value( options, "report" );
+	
+	bool quiet = options.contains( "--quiet" );
+	ProgressBar::set_quiet( quiet );
+	
+	//Limit the memory used by the images of each set
+	auto memory_limit = qint64( parse_int( get_option_value( options, "memory-limit" ), 0 ) ) * 1024 * 1024;
 	
 	//An optional string to append to the end of newly created files
 	//TODO: might not be used everywhere
@@ -152,17 +198,6 @@ int main( int argc, char* argv[] ){
 	else if( options.contains( "--evaluate" ) ){
 		evaluate_cgcompress( expandFolders( files ) );
 	}
-	else if( options.contains( "--diff-test" ) ){
-		auto file1 = QImage( files[0] );
-		auto file2 = QImage( files[1] );
-		ImageDiff( file2, file1, 3 );
-	}
-	else if( options.contains( "--diff-test-apply" ) ){
-		auto file1 = QImage( files[0] );
-		auto file2 = QImage( "ImageDiff-diff.webp" );
-		auto file3 = QImage( "ImageDiff-overlay.webp" );
-		ImageDiffCombine( file1, file2, file3 );
-	}
 	else if( options.contains( "--extract" ) ){
 		for( auto file : files )
 			extract_cgcompress( file, format );
@@ -175,20 +210,20 @@ int main( int argc, char* argv[] ){
 			auto images = extract_files( file );
 			QString name( QFileInfo(file).completeBaseName() + name_extension );
 			
-			MultiImage multi_img( format );
+			MultiImage multi_img( format, ImageStore( memory_limit ) );
 			for( auto image : images )
 				multi_img.append( Image( convert_img( {image.second} ) ) );
 			
-			optimizeImage( multi_img, name );
+			optimizeImage( multi_img, name, report_path );
 		}
 	}
 	else if( options.contains( "--combined" ) ){
-		MultiImage multi_img( format );
+		MultiImage multi_img( format, ImageStore( memory_limit ) );
 		for( auto file : files )
 			for( auto image : extract_files( file ) )
 				multi_img.append( Image( convert_img( image.second ) ) );
 		
-		optimizeImage( multi_img, QFileInfo(files[0]).completeBaseName() + name_extension );
+		optimizeImage( multi_img, QFileInfo(files[0]).completeBaseName() + name_extension, report_path );
 	}
 	else{
 		files = expandFolders( files );
@@ -201,26 +236,118 @@ int main( int argc, char* argv[] ){
 			return -1;
 		}
 		
+		//Inputs which already are in the frame store are mapped instead of decoded
+		std::unique_ptr<FrameStore> frame_store;
+		auto frame_store_path = get_option_value( options, "frame-store" );
+		if( !frame_store_path.isEmpty() ){
+			frame_store = std::make_unique<FrameStore>( frame_store_path );
+			if( !frame_store->is_open() )
+				qWarning( "Could not open frame store '%s'", frame_store_path.toLocal8Bit().constData() );
+		}
+		QStringList variant;
+		for( auto option : { "--noalpha", "--discard-transparent" } )
+			if( options.contains( option ) )
+				variant << option;
+		
+		//Decode files in the background, each one is only decoded once
+		auto load = [&]( int index ){
+				return QtConcurrent::run( [&,index](){
+						Trace::Span span( "load" );
+						auto decode = [&](){ return convert_img( QImage{files[index]} ); };
+						if( frame_store )
+							return frame_store->load( files[index], variant.join( " " ), decode );
+						return decode();
+					} );
+			};
+		QMap<int, QFuture<QImage>> pending;
+		auto prefetch = [&]( int index ){
+				if( index < files.size() && !pending.contains( index ) )
+					pending[index] = load( index );
+			};
+		
+		//Record finished sets, so an interrupted run can be resumed
+		bool resume = options.contains( "--resume" );
+		auto journal_path = get_option_value( options, "journal", resume ? "cgcompress.journal" : "" );
+		std::unique_ptr<Journal> journal;
+		if( !journal_path.isEmpty() ){
+			//Sets are only skipped if they were compressed the same way
+			QStringList journal_options{
+					QString( "--format=" ) + format.ext()
+				,	"--quality=" + QString::number( format.get_precision() )
+				,	"--name-extension=" + name_extension
+				};
+			if( format.get_add_offset() )
+				journal_options << "--add-offset";
+			if( format.get_virtual_ancestors() )
+				journal_options << "--virtual-ancestors";
+			journal_options << variant;
+			journal = std::make_unique<Journal>( journal_path, journal_options.join( " " ) );
+			if( !journal->is_open() ){
+				qWarning( "Could not open journal '%s'", journal_path.toLocal8Bit().constData() );
+				return -1;
+			}
+		}
+		
 		for( int start=0; start<files.size(); ){
 			auto name = QFileInfo(files[start]).completeBaseName();
-			qDebug() << "Compressing " << name;
-			MultiImage multi_img( format );
+			auto output = name + name_extension;
+			if( resume ){
+				int done = journal->completed( files, start, output + ".cgcompress" );
+				if( done > 0 ){
+					if( !report_path.isEmpty() ){
+						RunReport report;
+						report.set( "name", output );
+						report.set( "images", done );
+						report.set( "skipped", true );
+						if( !report.append_to( report_path ) )
+							qWarning( "Could not write report to '%s'", report_path.toLocal8Bit().constData() );
+					}
+					else if( !quiet )
+						qDebug() << "Skipping " << name << ", already compressed";
+					start += done;
+					
+					//The loads use the frame store, so they must finish before it is gone
+					for( auto index : pending.keys() )
+						pending[index].waitForFinished();
+					pending.clear();
+					continue;
+				}
+			}
+			
+			//The report contains the name instead
+			if( !quiet && report_path.isEmpty() )
+				qDebug() << "Compressing " << name;
+			MultiImage multi_img( format, ImageStore( memory_limit ) );
 			
 			QImage last;
 			for( int j=start; j<files.size(); j++ ){
-				QImage current = convert_img( QImage{files[j]} );
-				
+				//Decode the following file while this one is added. A file which
+				//does not belong to the set stays pending for the next set
+				prefetch( j );
+				QImage current = pending[j].result();
 				if( options.contains( "--auto" ) && !last.isNull() && !isSimilar( current, last ) )
 					break;
 				
+				pending.remove( j );
 				multi_img.append( Image( current ) );
 				last = current;
+				prefetch( j+1 );
 			}
 			
-			optimizeImage( multi_img, name + name_extension );
+			//Decode the start of the next set while this one is compressed
+			int next_start = start + multi_img.count();
+			prefetch( next_start );
+			prefetch( next_start + 1 );
+			
+			if( optimizeImage( multi_img, output, report_path ) == 0 && journal )
+				if( !journal->record( files.mid( start, multi_img.count() ), output + ".cgcompress" ) )
+					qWarning( "Could not record '%s' in the journal", output.toLocal8Bit().constData() );
 			start += multi_img.count();
 		}
 	}
 	
+	if( !trace_path.isEmpty() && !Trace::write( trace_path ) )
+		qWarning( "Could not write trace to '%s'", trace_path.toLocal8Bit().constData() );
+	
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,218 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Format.hpp"
+#include "MultiImage.hpp"
+#include "StageTimer.hpp"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <new>
+
+using namespace std;
+
+//Count every allocation done through operator new, array versions use these
+void* operator new( std::size_t size ){
+	StageTimer::count_allocation();
+	if( auto ptr = std::malloc( size ? size : 1 ) )
+		return ptr;
+	throw std::bad_alloc();
+}
+void operator delete( void* ptr ) noexcept{ std::free( ptr ); }
+void operator delete( void* ptr, std::size_t ) noexcept{ std::free( ptr ); }
+
+
+/** Print usage info to stdout */
+static void print_help(){
+	cout << "Usage:" << endl;
+	cout << "cgbench [options] [corpus folders]" << endl;
+	cout << endl;
+	cout << "Each folder is an image set, or contains one image set per sub-folder." << endl;
+	cout << endl;
+	cout << "Options:" << endl;
+	cout << "\t" << "--format=XXX        Format used for compressing, default is png" << endl;
+	cout << "\t" << "--quality=X,Y       Quality levels to compare, default is 0,1" << endl;
+	cout << "\t" << "--methods=X,Y       Optimizers to compare, default is optimize,optimize3" << endl;
+	cout << "\t" << "--virtual-ancestors Let frames branch from images which are not in the set" << endl;
+	cout << "\t" << "--label=XXX         Name of this run, such as the version or commit" << endl;
+	cout << "\t" << "--output=file.json  Write the report to a file instead of stdout" << endl;
+}
+
+/** Retrieves XXX from --name=XXX
+ *  \param [in] options All the options
+ *  \param [in] name Name of the parameter, without "--" and "="
+ *  \param [in] default_value Returned if the option is not present
+ *  \return The value of the option */
+static QString get_option_value( QStringList options, QString name, QString default_value={} ){
+	name = "--" + name + "=";
+	for( auto opt : options )
+		if( opt.startsWith( name ) )
+			return opt.right( opt.size() - name.size() );
+	return default_value;
+}
+
+struct ImageSet{
+	QString name;
+	QStringList files;
+};
+
+/** \return The image files directly in **dir**, sorted by name */
+static QStringList image_files( QDir dir ){
+	QStringList filters;
+	for( auto format : QImageReader::supportedImageFormats() )
+		filters << "*." + QString( format );
+	
+	QStringList files;
+	for( auto info : dir.entryInfoList( filters, QDir::Files, QDir::Name ) )
+		files << info.filePath();
+	return files;
+}
+
+/** \return The image sets in a corpus folder */
+static QList<ImageSet> find_sets( QString path ){
+	QDir dir( path );
+	QList<ImageSet> sets;
+	
+	auto files = image_files( dir );
+	if( !files.isEmpty() )
+		sets.append( { QFileInfo( path ).fileName(), files } );
+	
+	for( auto sub : dir.entryInfoList( QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name ) ){
+		auto sub_files = image_files( QDir( sub.filePath() ) );
+		if( !sub_files.isEmpty() )
+			sets.append( { QFileInfo( path ).fileName() + "/" + sub.fileName(), sub_files } );
+	}
+	
+	return sets;
+}
+
+/** Compress a set once and measure it
+ *  \param [in] set The images to compress
+ *  \param [in] method Name of the MultiImage optimizer to use
+ *  \param [in] format The format and quality to use
+ *  \param [in] output Path of the temporary output, without extension
+ *  \return The measurements as JSON */
+static QJsonObject run( const ImageSet& set, QString method, Format format, QString output ){
+	MultiImage images( format );
+	for( auto file : set.files )
+		images.append( Image( QImage( file ) ) );
+	
+	StageTimer::reset();
+	QElapsedTimer wall;
+	wall.start();
+	auto cpu = std::clock();
+	
+	//optimize() also round trips through the image plugin, if it is installed
+	bool success = (method == "optimize3") ? images.optimize3( output ) : images.optimize( output );
+	auto path = output + ".cgcompress";
+	
+	QJsonObject result;
+	result["set"] = set.name;
+	result["images"] = set.files.size();
+	result["method"] = method;
+	result["quality"] = format.get_precision();
+	result["format"] = QString( format.ext() );
+	result["success"] = success;
+	result["output_size"] = double( QFileInfo( path ).size() );
+	result["wall_ms"] = wall.nsecsElapsed() / 1000000.0;
+	result["cpu_ms"] = (std::clock() - cpu) * 1000.0 / CLOCKS_PER_SEC;
+	
+	QJsonArray stages;
+	for( auto record : StageTimer::records() ){
+		QJsonObject stage;
+		stage["name"] = record.name;
+		stage["wall_ms"] = record.wall_ms;
+		stage["cpu_ms"] = record.cpu_ms;
+		stage["allocations"] = double( record.allocations );
+		stages.append( stage );
+	}
+	result["stages"] = stages;
+	
+	QFile::remove( path );
+	return result;
+}
+
+int main( int argc, char* argv[] ){
+	QCoreApplication app( argc, argv );
+	
+	QStringList args = app.arguments();
+	args.removeFirst();
+	
+	QStringList options, folders;
+	for( auto arg : args )
+		if( arg.startsWith( "--" ) )
+			options << arg;
+		else
+			folders << arg;
+	
+	if( options.contains( "--help" ) || folders.isEmpty() ){
+		print_help();
+		return folders.isEmpty() ? -1 : 0;
+	}
+	
+	Format format( get_option_value( options, "format", "png" ) );
+	format.set_virtual_ancestors( options.contains( "--virtual-ancestors" ) );
+	auto qualities = get_option_value( options, "quality", "0,1" ).split( ",", QString::SkipEmptyParts );
+	auto methods = get_option_value( options, "methods", "optimize,optimize3" ).split( ",", QString::SkipEmptyParts );
+	
+	QTemporaryDir temp;
+	if( !temp.isValid() ){
+		qWarning( "Could not create a temporary folder for the output" );
+		return -1;
+	}
+	
+	QJsonArray runs;
+	for( auto folder : folders )
+		for( auto set : find_sets( folder ) )
+			for( auto method : methods )
+				for( auto quality : qualities ){
+					format.set_precision( quality.toInt() );
+					cerr << "Running " << set.name.toLocal8Bit().constData()
+						<< " with " << method.toLocal8Bit().constData()
+						<< " at quality " << quality.toLocal8Bit().constData() << endl;
+					runs.append( run( set, method, format, temp.filePath( "bench" ) ) );
+				}
+	
+	QJsonObject report;
+	report["label"] = get_option_value( options, "label" );
+	report["runs"] = runs;
+	auto json = QJsonDocument( report ).toJson();
+	
+	auto output = get_option_value( options, "output" );
+	if( output.isEmpty() )
+		cout << json.constData();
+	else{
+		QFile file( output );
+		if( !file.open( QIODevice::WriteOnly ) || file.write( json ) != json.size() ){
+			qWarning( "Could not write report to '%s'", output.toLocal8Bit().constData() );
+			return -1;
+		}
+	}
+	
+	return 0;
+}
@@ -0,0 +1,334 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Image.hpp"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+/** Print usage info to stdout */
+static void print_help(){
+	cout << "Usage:" << endl;
+	cout << "cgsynth [options] output-folder" << endl;
+	cout << endl;
+	cout << "Options:" << endl;
+	cout << "\t" << "--seed=X           Seed for the generator, the same seed gives the same set" << endl;
+	cout << "\t" << "--frames=X         Amount of frames to generate, default is 10" << endl;
+	cout << "\t" << "--size=WxH         Size of the frames, default is 1280x720" << endl;
+	cout << "\t" << "--overlays=X       Amount of distinct overlays, default is 8" << endl;
+	cout << "\t" << "--area=X           Area of each overlay in percent of the frame, default is 5" << endl;
+	cout << "\t" << "--noise=X          Largest random change of each channel in overlays, default is 0" << endl;
+	cout << "\t" << "--transparency=X   Percentage of partially transparent overlay pixels, default is 0" << endl;
+	cout << "\t" << "--shift=X          Largest colour shift of the lighting variants, default is 0" << endl;
+	cout << "\t" << "--lightings=X      Amount of lighting variants of the base, default is 1" << endl;
+}
+
+/** Retrieves XXX from --name=XXX
+ *  \param [in] options All the options
+ *  \param [in] name Name of the parameter, without "--" and "="
+ *  \param [in] default_value Returned if the option is not present
+ *  \return The value of the option */
+static int get_option_value( QStringList options, QString name, int default_value ){
+	name = "--" + name + "=";
+	for( auto opt : options )
+		if( opt.startsWith( name ) ){
+			bool ok = false;
+			auto value = opt.right( opt.size() - name.size() ).toInt( &ok );
+			return ok ? value : default_value;
+		}
+	return default_value;
+}
+
+/** Random numbers which are the same on every platform, as the standard
+ *  distributions are implementation defined */
+class Random{
+	private:
+		std::mt19937 engine;
+		
+	public:
+		explicit Random( uint32_t seed ) : engine( seed ) { }
+		
+		/** \return A number in [**low**,**high**] */
+		int range( int low, int high )
+			{ return low + int( engine() % uint32_t( high - low + 1 ) ); }
+		
+		/** \return true with **percent** percent probability */
+		bool chance( int percent ){ return range( 0, 99 ) < percent; }
+		
+		QRgb colour( int alpha=255 )
+			{ return qRgba( range( 0, 255 ), range( 0, 255 ), range( 0, 255 ), alpha ); }
+};
+
+static int clamp_channel( int value ){ return std::min( std::max( value, 0 ), 255 ); }
+
+/** \return **a** and **b** mixed, with **t** in [0,**max**] */
+static QRgb mix( QRgb a, QRgb b, int t, int max ){
+	auto channel = [&]( int x, int y ){ return (x * (max - t) + y * t) / std::max( max, 1 ); };
+	return qRgba( channel( qRed(   a ), qRed(   b ) )
+	            , channel( qGreen( a ), qGreen( b ) )
+	            , channel( qBlue(  a ), qBlue(  b ) )
+	            , channel( qAlpha( a ), qAlpha( b ) )
+	            );
+}
+
+/** \return An opaque base image with gradients and flat shapes, which
+ *  compresses somewhat like line-art */
+static QImage make_base( Random& random, QSize size ){
+	QImage base( size, QImage::Format_ARGB32 );
+	auto top = random.colour(), bottom = random.colour();
+	for( int iy=0; iy<size.height(); iy++ ){
+		auto row = (QRgb*)base.scanLine( iy );
+		std::fill( row, row + size.width(), mix( top, bottom, iy, size.height() - 1 ) );
+	}
+	
+	for( int i=0; i<24; i++ ){
+		int w = random.range( size.width()  / 16, size.width()  / 3 );
+		int h = random.range( size.height() / 16, size.height() / 3 );
+		int x = random.range( 0, size.width()  - w );
+		int y = random.range( 0, size.height() - h );
+		auto colour = random.colour();
+		bool ellipse = random.chance( 50 );
+		
+		for( int iy=0; iy<h; iy++ ){
+			auto row = (QRgb*)base.scanLine( y + iy ) + x;
+			for( int ix=0; ix<w; ix++ ){
+				//Normalized distance from the centre, for ellipses
+				double dx = (ix - w/2.0) / (w/2.0), dy = (iy - h/2.0) / (h/2.0);
+				if( !ellipse || dx*dx + dy*dy <= 1.0 )
+					row[ix] = colour;
+			}
+		}
+	}
+	
+	return base;
+}
+
+/** \return **img** with each channel shifted by **shift**, the alpha is kept */
+static QImage shift_colours( QImage img, const int shift[3] ){
+	for( int iy=0; iy<img.height(); iy++ ){
+		auto row = (QRgb*)img.scanLine( iy );
+		for( int ix=0; ix<img.width(); ix++ )
+			row[ix] = qRgba( clamp_channel( qRed(   row[ix] ) + shift[0] )
+			               , clamp_channel( qGreen( row[ix] ) + shift[1] )
+			               , clamp_channel( qBlue(  row[ix] ) + shift[2] )
+			               , qAlpha( row[ix] )
+			               );
+	}
+	return img;
+}
+
+struct Overlay{
+	QPoint pos;
+	QImage img;
+};
+
+/** Create an elliptic overlay with a gradient fill
+ *  \param [in] random Source of randomness
+ *  \param [in] size Size of the frames
+ *  \param [in] area Area of the bounding rectangle, in percent of the frame
+ *  \param [in] noise Largest random change of each channel
+ *  \param [in] transparency Percentage of shown pixels which are partially transparent
+ *  \return The overlay, fully transparent outside the ellipse */
+static Overlay make_overlay( Random& random, QSize size, int area, int noise, int transparency ){
+	//Pick a size with the wanted area, and an aspect ratio between 1:2 and 2:1
+	double pixels = size.width() * size.height() * area / 100.0;
+	double aspect = random.range( 50, 200 ) / 100.0;
+	int w = std::min( std::max( int( std::sqrt( pixels * aspect ) ), 1 ), size.width()  );
+	int h = std::min( std::max( int( pixels / w ), 1 ), size.height() );
+	
+	Overlay overlay;
+	overlay.pos = { random.range( 0, size.width() - w ), random.range( 0, size.height() - h ) };
+	overlay.img = QImage( w, h, QImage::Format_ARGB32 );
+	
+	auto start = random.colour(), end = random.colour();
+	for( int iy=0; iy<h; iy++ ){
+		auto row = (QRgb*)overlay.img.scanLine( iy );
+		for( int ix=0; ix<w; ix++ ){
+			double dx = (ix - w/2.0) / (w/2.0), dy = (iy - h/2.0) / (h/2.0);
+			if( dx*dx + dy*dy > 1.0 ){
+				row[ix] = qRgba( 0, 0, 0, 0 );
+				continue;
+			}
+			
+			auto pixel = mix( start, end, ix, w - 1 );
+			auto change = [&]( int value )
+				{ return noise > 0 ? clamp_channel( value + random.range( -noise, noise ) ) : value; };
+			int alpha = random.chance( transparency ) ? random.range( 32, 224 ) : 255;
+			row[ix] = qRgba( change( qRed( pixel ) ), change( qGreen( pixel ) ), change( qBlue( pixel ) ), alpha );
+		}
+	}
+	
+	return overlay;
+}
+
+/** \return **overlay** as a layer painted with source-over at its position.
+ *  The position of an Image is also where its pixels start in the QImage, so
+ *  the overlay is placed at that position in a transparent QImage first */
+static Image overlay_layer( const Overlay& overlay ){
+	auto pos = overlay.pos;
+	auto size = overlay.img.size();
+	QImage padded( pos.x() + size.width(), pos.y() + size.height(), QImage::Format_ARGB32 );
+	padded.fill( 0 );
+	for( int iy=0; iy<size.height(); iy++ ){
+		auto in = (const QRgb*)overlay.img.constScanLine( iy );
+		std::copy( in, in + size.width(), (QRgb*)padded.scanLine( iy + pos.y() ) + pos.x() );
+	}
+	
+	return Image( {0,0}, padded )
+		.sub_image( pos.x(), pos.y(), size.width(), size.height() )
+		.with_mode( Blending::Mode::SOURCE_OVER );
+}
+
+/** \return The path of a file in **dir** */
+static QString path( const QDir& dir, QString name ){ return dir.filePath( name ); }
+
+static QString numbered( QString prefix, int number ){
+	return QString( "%1%2.png" ).arg( prefix ).arg( number, 4, 10, QLatin1Char('0') );
+}
+
+int main( int argc, char* argv[] ){
+	QCoreApplication app( argc, argv );
+	
+	QStringList args = app.arguments();
+	args.removeFirst();
+	
+	QStringList options, folders;
+	for( auto arg : args )
+		if( arg.startsWith( "--" ) )
+			options << arg;
+		else
+			folders << arg;
+	
+	if( options.contains( "--help" ) || folders.size() != 1 ){
+		print_help();
+		return folders.size() == 1 ? 0 : -1;
+	}
+	
+	auto seed     = get_option_value( options, "seed",         1 );
+	auto frames   = get_option_value( options, "frames",      10 );
+	auto overlays = get_option_value( options, "overlays",     8 );
+	auto area     = get_option_value( options, "area",         5 );
+	auto noise    = get_option_value( options, "noise",        0 );
+	auto transp   = get_option_value( options, "transparency", 0 );
+	auto shift    = get_option_value( options, "shift",        0 );
+	auto lightings= std::max( get_option_value( options, "lightings", 1 ), 1 );
+	
+	QSize size( 1280, 720 );
+	for( auto opt : options )
+		if( opt.startsWith( "--size=" ) ){
+			auto parts = opt.mid( 7 ).split( "x" );
+			if( parts.size() == 2 && parts[0].toInt() > 0 && parts[1].toInt() > 0 )
+				size = { parts[0].toInt(), parts[1].toInt() };
+		}
+	
+	QDir dir( folders[0] );
+	if( !dir.mkpath( "layers" ) ){
+		qWarning( "Could not create '%s'", folders[0].toLocal8Bit().constData() );
+		return -1;
+	}
+	
+	Random random( seed );
+	QJsonObject manifest;
+	manifest["seed"] = seed;
+	manifest["width"] = size.width();
+	manifest["height"] = size.height();
+	
+	//The base, and its lighting variants. The first is always unchanged
+	auto base = make_base( random, size );
+	QList<Image> bases;
+	QJsonArray lighting_list;
+	for( int i=0; i<lightings; i++ ){
+		int offsets[3] = { 0, 0, 0 };
+		if( i > 0 )
+			for( auto& offset : offsets )
+				offset = random.range( -shift, shift );
+		
+		auto name = numbered( "layers/lighting-", i );
+		auto lit = shift_colours( base, offsets );
+		lit.save( path( dir, name ) );
+		bases << Image( lit );
+		
+		QJsonObject lighting;
+		lighting["file"] = name;
+		lighting["shift"] = QJsonArray{ offsets[0], offsets[1], offsets[2] };
+		lighting_list.append( lighting );
+	}
+	manifest["lightings"] = lighting_list;
+	
+	QList<Image> overlay_images;
+	QJsonArray overlay_list;
+	for( int i=0; i<overlays; i++ ){
+		auto overlay = make_overlay( random, size, area, noise, transp );
+		auto name = numbered( "layers/overlay-", i );
+		overlay.img.save( path( dir, name ) );
+		overlay_images << overlay_layer( overlay );
+		
+		QJsonObject info;
+		info["file"] = name;
+		info["x"] = overlay.pos.x();
+		info["y"] = overlay.pos.y();
+		info["width"] = overlay.img.width();
+		info["height"] = overlay.img.height();
+		overlay_list.append( info );
+	}
+	manifest["overlays"] = overlay_list;
+	
+	//Each frame is a lighting with some of the overlays painted on top
+	QJsonArray frame_list;
+	for( int i=0; i<frames; i++ ){
+		auto lighting = random.range( 0, lightings - 1 );
+		auto frame = bases[lighting];
+		QJsonArray used;
+		for( int j=0; j<overlays; j++ )
+			if( random.chance( 30 ) ){
+				frame.blend( overlay_images[j] );
+				used.append( j );
+			}
+		
+		auto name = numbered( "frame-", i );
+		frame.qimg().save( path( dir, name ) );
+		
+		QJsonObject info;
+		info["file"] = name;
+		info["lighting"] = lighting;
+		info["overlays"] = used;
+		frame_list.append( info );
+		cout << "Generated " << name.toLocal8Bit().constData() << endl;
+	}
+	manifest["frames"] = frame_list;
+	
+	QFile file( path( dir, "manifest.json" ) );
+	auto json = QJsonDocument( manifest ).toJson();
+	if( !file.open( QIODevice::WriteOnly ) || file.write( json ) != json.size() ){
+		qWarning( "Could not write the manifest" );
+		return -1;
+	}
+	
+	return 0;
+}
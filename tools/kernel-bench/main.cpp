@@ -0,0 +1,201 @@
+/*
+	This file is part of cgCompress.
+
+	cgCompress is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cgCompress is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cgCompress.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Image.hpp"
+#include "FileSizeEval.hpp"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+/** Print usage info to stdout */
+static void print_help(){
+	cout << "Usage:" << endl;
+	cout << "kernel-bench [options]" << endl;
+	cout << endl;
+	cout << "Options:" << endl;
+	cout << "\t" << "--sizes=X,Y        Widths of the square test images, default is 256,1024,2048" << endl;
+	cout << "\t" << "--densities=X,Y    Percentage of changed pixels, default is 1,10,50" << endl;
+	cout << "\t" << "--min-time=X       Minimum time to run each kernel in ms, default is 200" << endl;
+	cout << "\t" << "--filter=XXX       Only run kernels containing XXX in their name" << endl;
+	cout << "\t" << "--json             Output one JSON object per line instead of a table" << endl;
+}
+
+/** Retrieves XXX from --name=XXX
+ *  \param [in] options All the options
+ *  \param [in] name Name of the parameter, without "--" and "="
+ *  \param [in] default_value Returned if the option is not present
+ *  \return The value of the option */
+static QString get_option_value( QStringList options, QString name, QString default_value={} ){
+	name = "--" + name + "=";
+	for( auto opt : options )
+		if( opt.startsWith( name ) )
+			return opt.right( opt.size() - name.size() );
+	return default_value;
+}
+
+static QList<int> parse_list( QString list ){
+	QList<int> values;
+	for( auto value : list.split( ",", QString::SkipEmptyParts ) )
+		if( value.toInt() > 0 )
+			values << value.toInt();
+	return values;
+}
+
+/** Keeps results alive, so the compiler can not remove the work */
+static volatile int sink = 0;
+
+/** The inputs of the kernels, for one size and density */
+struct Inputs{
+	QImage base;   ///< Smooth image with some noise
+	QImage first;  ///< **base** with a block of changed pixels
+	QImage second; ///< **base** with another block, overlapping half of the first
+	Image diff;    ///< The difference from **base** to **first**
+	Image other;   ///< The difference from **base** to **second**
+	
+	Inputs( int size, int density ) : diff( QImage() ), other( QImage() ) {
+		std::mt19937 random( size * 1000 + density );
+		base = QImage( size, size, QImage::Format_ARGB32 );
+		for( int iy=0; iy<size; iy++ ){
+			auto row = (QRgb*)base.scanLine( iy );
+			for( int ix=0; ix<size; ix++ )
+				row[ix] = qRgb( ix * 255 / size, iy * 255 / size, (ix + iy + random() % 8) & 255 );
+		}
+		
+		//The changed blocks cover **density** percent of the image
+		int side = std::max( int( size * std::sqrt( density / 100.0 ) ), 1 );
+		auto change = [&]( int x, int y ){
+				QImage changed = base.copy();
+				for( int iy=y; iy<std::min( y+side, size ); iy++ ){
+					auto row = (QRgb*)changed.scanLine( iy );
+					for( int ix=x; ix<std::min( x+side, size ); ix++ )
+						row[ix] = qRgba( random() & 255, random() & 255, random() & 255, 255 );
+				}
+				return changed;
+			};
+		int pos = (size - side) / 2;
+		first  = change( pos, pos );
+		second = change( pos + side/2, pos );
+		diff  = Image( base ).difference( Image( first  ) );
+		other = Image( base ).difference( Image( second ) );
+	}
+};
+
+struct Kernel{
+	const char* name;
+	std::function<void( const Inputs& )> run;
+};
+
+/** The kernels to measure. difference() gets new images for each run, so
+ *  it includes calculating the row hashes */
+static const Kernel kernels[] = {
+		{ "difference", []( const Inputs& in ){
+			sink = Image( in.base ).difference( Image( in.first ) ).get_rect().width();
+		} }
+	,	{ "contain_both", []( const Inputs& in ){
+			sink = in.diff.contain_both( in.other ).is_valid();
+		} }
+	,	{ "split_shared", []( const Inputs& in ){
+			sink = in.diff.split_shared( in.other ).shared.is_valid();
+		} }
+	,	{ "clean_alpha", []( const Inputs& in ){
+			sink = in.diff.clean_alpha( 3, 4 ).get_rect().width();
+		} }
+	,	{ "remove_transparent", []( const Inputs& in ){
+			sink = in.diff.remove_transparent().width();
+		} }
+	,	{ "auto_crop", []( const Inputs& in ){
+			sink = in.diff.auto_crop().get_rect().width();
+		} }
+	,	{ "image_gradient_sum", []( const Inputs& in ){
+			sink = FileSize::image_gradient_sum( in.first );
+		} }
+	,	{ "image_gradient_sum_masked", []( const Inputs& in ){
+			sink = in.diff.estimate_compressed_size( Format() );
+		} }
+	,	{ "lz4compress_size", []( const Inputs& in ){
+			sink = FileSize::lz4compress_size( in.first );
+		} }
+	};
+
+/** Run **kernel** repeatedly for at least **min_time** ms
+ *  \return The amount of input pixels handled per second */
+static double measure( const Kernel& kernel, const Inputs& inputs, int min_time ){
+	kernel.run( inputs ); //Warm up
+	
+	QElapsedTimer timer;
+	timer.start();
+	long runs = 0;
+	do{
+		kernel.run( inputs );
+		runs++;
+	}while( timer.elapsed() < min_time );
+	
+	double seconds = timer.nsecsElapsed() / 1e9;
+	double pixels = double( inputs.base.width() ) * inputs.base.height();
+	return pixels * runs / seconds;
+}
+
+int main( int argc, char* argv[] ){
+	QCoreApplication app( argc, argv );
+	
+	QStringList options = app.arguments();
+	options.removeFirst();
+	if( options.contains( "--help" ) ){
+		print_help();
+		return 0;
+	}
+	
+	auto sizes = parse_list( get_option_value( options, "sizes", "256,1024,2048" ) );
+	auto densities = parse_list( get_option_value( options, "densities", "1,10,50" ) );
+	auto min_time = std::max( get_option_value( options, "min-time", "200" ).toInt(), 1 );
+	auto filter = get_option_value( options, "filter" );
+	bool json = options.contains( "--json" );
+	
+	if( !json )
+		cout << "kernel                        size  density   Mpixels/s" << endl;
+	
+	for( auto size : sizes )
+		for( auto density : densities ){
+			Inputs inputs( size, std::min( density, 100 ) );
+			for( auto& kernel : kernels ){
+				if( !filter.isEmpty() && !QString( kernel.name ).contains( filter ) )
+					continue;
+				
+				auto speed = measure( kernel, inputs, min_time );
+				if( json )
+					cout << "{\"kernel\":\"" << kernel.name << "\",\"size\":" << size
+						<< ",\"density\":" << density << ",\"pixels_per_second\":" << std::fixed << speed << "}" << endl;
+				else
+					cout << QString( "%1 %2 %3% %4" )
+						.arg( kernel.name, -26 )
+						.arg( size, 8 )
+						.arg( density, 7 )
+						.arg( speed / 1e6, 11, 'f', 1 )
+						.toLocal8Bit().constData() << endl;
+			}
+		}
+	
+	return 0;
+}